@@ -374,6 +374,16 @@ void Application::Start() {
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+    callbacks.on_utterance_end = [this](int confidence) {
+        Schedule([this, confidence]() {
+            // Only auto stop turns end on the device, in the other modes the user or the server decides
+            if (device_state_ == kDeviceStateListening && listening_mode_ == kListeningModeAutoStop) {
+                ESP_LOGI(TAG, "End of utterance detected (confidence %d%%), stop listening", confidence);
+                protocol_->SendStopListening();
+                SetDeviceState(kDeviceStateIdle);
+            }
+        });
+    };
     audio_service_.SetCallbacks(callbacks);
 
     // Start the main event loop task with priority 3
@@ -423,13 +433,19 @@ void Application::Start() {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
-    protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+    protocol_->OnIncomingAudio([this](AudioStreamPacketPtr packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
+    protocol_->SetClientFrameDuration(audio_service_.GetPreferredFrameDuration());
+    protocol_->OnAudioChannelOpening([this]() {
+        SendWakeWordAudio();
+    });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveMode(false);
+        // The frame duration answered in the server hello, servers that do not answer keep the proposed one
+        audio_service_.SetFrameDuration(protocol_->session_frame_duration());
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -437,6 +453,7 @@ void Application::Start() {
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
+        protocol_->SetClientFrameDuration(audio_service_.GetPreferredFrameDuration());
         Schedule([this]() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
@@ -575,9 +592,12 @@ void Application::MainEventLoop() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+                int64_t encoded_time = packet->time_us;
                 if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                    audio_service_.ReportSendFailure();
                     break;
                 }
+                audio_service_.RecordLatency(kAudioLatencySend, encoded_time);
             }
         }
 
@@ -611,6 +631,7 @@ void Application::MainEventLoop() {
                 // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
                 // SystemInfo::PrintTaskList();
                 SystemInfo::PrintHeapStats();
+                audio_service_.PrintDebugStatistics();
             }
         }
     }
@@ -623,10 +644,15 @@ void Application::OnWakeWordDetected() {
 
     if (device_state_ == kDeviceStateIdle) {
         audio_service_.EncodeWakeWord();
+#if CONFIG_SEND_WAKE_WORD_DATA
+        // Sent as soon as the audio channel can carry it, possibly before the server hello
+        wake_word_audio_pending_ = true;
+#endif
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
+                wake_word_audio_pending_ = false;
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
@@ -635,10 +661,7 @@ void Application::OnWakeWordDetected() {
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_SEND_WAKE_WORD_DATA
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
+        SendWakeWordAudio();
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
         SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
@@ -654,6 +677,17 @@ void Application::OnWakeWordDetected() {
     }
 }
 
+void Application::SendWakeWordAudio() {
+    if (!wake_word_audio_pending_) {
+        return;
+    }
+    wake_word_audio_pending_ = false;
+    // The packets were encoded in the background while the wake word was spoken
+    while (auto packet = audio_service_.PopWakeWordPacket()) {
+        protocol_->SendAudio(std::move(packet));
+    }
+}
+
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
@@ -798,10 +832,14 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
 
     if (device_state_ == kDeviceStateIdle) {
         audio_service_.EncodeWakeWord();
+#if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
+        wake_word_audio_pending_ = true;
+#endif
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
             if (!protocol_->OpenAudioChannel()) {
+                wake_word_audio_pending_ = false;
                 audio_service_.EnableWakeWordDetection(true);
                 return;
             }
@@ -809,10 +847,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
 
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
+        SendWakeWordAudio();
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
         SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
@@ -81,11 +81,13 @@ private:
 
     bool has_server_time_ = false;
     bool aborted_ = false;
+    bool wake_word_audio_pending_ = false;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
     TaskHandle_t main_event_loop_task_handle_ = nullptr;
 
     void OnWakeWordDetected();
+    void SendWakeWordAudio();
     void CheckNewVersion(Ota& ota);
     void CheckAssetsVersion();
     void ShowActivationCode(const std::string& code, const std::string& message);
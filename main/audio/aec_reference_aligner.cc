@@ -0,0 +1,144 @@
+#include "aec_reference_aligner.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+#include <esp_log.h>
+
+#define TAG "AecReferenceAligner"
+
+#define DECIMATION 4
+// 256 ms at the decimated rate of 4 kHz
+#define WINDOW_SAMPLES 1024
+// Reference level below which nothing is playing, after decimation
+#define MIN_REFERENCE_RMS 64
+// Normalized correlation peak a window needs to count
+#define MIN_CORRELATION 0.3f
+// Windows that must agree within one lag before the alignment moves
+#define CONSISTENT_WINDOWS 3
+// Changes of the estimate smaller than this (1 ms) leave the alignment alone
+#define MIN_SHIFT_CHANGE 16
+
+AecReferenceAligner::AecReferenceAligner(int max_delay_ms, int lead_ms)
+    : max_lag_(max_delay_ms * 16000 / 1000 / DECIMATION),
+      lead_samples_(lead_ms * 16000 / 1000),
+      delay_us_(INT32_MIN) {
+}
+
+void AecReferenceAligner::Process(int16_t* data, size_t frames, int channels) {
+    if (channels < 2) {
+        return;
+    }
+    /* Allocated on first use, boards without a reference never pay for the buffers */
+    if (microphone_.empty()) {
+        microphone_.resize(WINDOW_SAMPLES + 2 * max_lag_);
+        reference_.resize(WINDOW_SAMPLES + 2 * max_lag_);
+    }
+
+    /* Estimate on the raw input, so the alignment applied does not feed back */
+    for (size_t i = 0; i < frames; i++) {
+        decimate_microphone_ += data[i * channels];
+        decimate_reference_ += data[i * channels + channels - 1];
+        if (++decimate_count_ < DECIMATION) {
+            continue;
+        }
+        microphone_[filled_] = decimate_microphone_ / DECIMATION;
+        reference_[filled_] = decimate_reference_ / DECIMATION;
+        decimate_microphone_ = 0;
+        decimate_reference_ = 0;
+        decimate_count_ = 0;
+        if (++filled_ == microphone_.size()) {
+            Estimate();
+            filled_ = 0;
+        }
+    }
+
+    ApplyShift(data, frames, channels);
+}
+
+void AecReferenceAligner::Estimate() {
+    /* mic[n] ~ ref[n - lag], searched over +-max_lag_ around the middle of the buffers */
+    const int first = max_lag_;
+    const int last = max_lag_ + WINDOW_SAMPLES;
+
+    int64_t reference_energy = 0;
+    for (int16_t sample : reference_) {
+        reference_energy += (int32_t)sample * sample;
+    }
+    if (reference_energy < (int64_t)MIN_REFERENCE_RMS * MIN_REFERENCE_RMS * (int64_t)reference_.size()) {
+        return;
+    }
+
+    int64_t best = 0;
+    int best_lag = 0;
+    for (int lag = -max_lag_; lag <= max_lag_; lag++) {
+        int64_t sum = 0;
+        const int16_t* reference = reference_.data() - lag;
+        for (int n = first; n < last; n++) {
+            sum += (int32_t)microphone_[n] * reference[n];
+        }
+        sum = std::llabs(sum);
+        if (sum > best) {
+            best = sum;
+            best_lag = lag;
+        }
+    }
+
+    int64_t microphone_energy = 0;
+    int64_t window_reference_energy = 0;
+    for (int n = first; n < last; n++) {
+        microphone_energy += (int32_t)microphone_[n] * microphone_[n];
+        window_reference_energy += (int32_t)reference_[n - best_lag] * reference_[n - best_lag];
+    }
+    if (microphone_energy == 0) {
+        return;
+    }
+    float correlation = best / std::sqrt((float)microphone_energy * (float)window_reference_energy);
+    if (correlation < MIN_CORRELATION) {
+        return;
+    }
+
+    if (std::abs(best_lag - candidate_lag_) <= 1) {
+        candidate_count_++;
+    } else {
+        candidate_lag_ = best_lag;
+        candidate_count_ = 1;
+    }
+    if (candidate_count_ < CONSISTENT_WINDOWS) {
+        return;
+    }
+
+    int delay_samples = best_lag * DECIMATION;
+    delay_us_ = delay_samples * 1000000 / 16000;
+    int shift = delay_samples - lead_samples_;
+    if (std::abs(shift - shift_samples_) >= MIN_SHIFT_CHANGE) {
+        ESP_LOGI(TAG, "Reference leads the echo by %ld us (correlation %.2f), delaying the %s by %d samples",
+            (long)delay_us_.load(), correlation, shift >= 0 ? "reference" : "microphones", std::abs(shift));
+        shift_samples_ = shift;
+    }
+}
+
+void AecReferenceAligner::ApplyShift(int16_t* data, size_t frames, int channels) {
+    /* The delay line keeps the last input frames, so a new shift takes effect without a gap */
+    if (channels != channels_) {
+        channels_ = channels;
+        delay_line_.assign((max_lag_ * DECIMATION + lead_samples_ + 1) * channels, 0);
+        delay_position_ = 0;
+    }
+    const size_t length = delay_line_.size() / channels;
+    const int shift = shift_samples_;
+    const size_t delay = std::min<size_t>(std::abs(shift), length - 1);
+
+    for (size_t i = 0; i < frames; i++) {
+        int16_t* frame = data + i * channels;
+        std::copy(frame, frame + channels, delay_line_.data() + delay_position_ * channels);
+        const int16_t* delayed = delay_line_.data() + (delay_position_ + length - delay) % length * channels;
+        if (shift > 0) {
+            frame[channels - 1] = delayed[channels - 1];
+        } else if (shift < 0) {
+            std::copy(delayed, delayed + channels - 1, frame);
+        }
+        delay_position_ = (delay_position_ + 1) % length;
+    }
+}
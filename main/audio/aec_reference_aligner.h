@@ -0,0 +1,56 @@
+#ifndef AEC_REFERENCE_ALIGNER_H
+#define AEC_REFERENCE_ALIGNER_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Measures how far the AEC reference channel leads the echo in the microphones and shifts
+ * the channels so that it leads by a small fixed margin (CONFIG_USE_AEC_DELAY_ESTIMATION).
+ *
+ * Estimation runs on the raw input while something plays: the first microphone and the
+ * reference (the last channel) are decimated to 4 kHz and cross-correlated over 256 ms
+ * windows. A window counts if its normalized correlation peak is strong enough, and the
+ * alignment only moves after consecutive windows agree, so double talk and silence do not
+ * disturb it. A reference that leads too much is delayed, one that lags makes the
+ * microphones wait for it.
+ *
+ * Only the input task calls Process(), the getters may be read from any task.
+ */
+class AecReferenceAligner {
+public:
+    AecReferenceAligner(int max_delay_ms, int lead_ms);
+
+    // Estimate on `frames` interleaved frames, then apply the current alignment in place
+    void Process(int16_t* data, size_t frames, int channels);
+
+    // How far the reference leads the echo, negative if it lags, INT32_MIN before the first estimate
+    inline int32_t delay_us() const { return delay_us_; }
+    // Samples the reference is delayed by, negative if the microphones are delayed instead
+    inline int shift_samples() const { return shift_samples_; }
+
+private:
+    const int max_lag_;
+    const int lead_samples_;
+    std::vector<int16_t> microphone_;
+    std::vector<int16_t> reference_;
+    size_t filled_ = 0;
+    int32_t decimate_microphone_ = 0;
+    int32_t decimate_reference_ = 0;
+    int decimate_count_ = 0;
+    int candidate_lag_ = 0;
+    int candidate_count_ = 0;
+    std::atomic<int32_t> delay_us_;
+    std::atomic<int> shift_samples_ = 0;
+
+    int channels_ = 0;
+    std::vector<int16_t> delay_line_;
+    size_t delay_position_ = 0;
+
+    void Estimate();
+    void ApplyShift(int16_t* data, size_t frames, int channels);
+};
+
+#endif // AEC_REFERENCE_ALIGNER_H
@@ -35,6 +35,14 @@ void AudioCodec::Start() {
     }
 
     if (tx_handle_ != nullptr) {
+        /* Count the DMA buffers for underrun telemetry, callbacks can only be registered before enabling */
+        i2s_event_callbacks_t callbacks = {};
+        callbacks.on_sent = OnOutputSent;
+        callbacks.on_send_q_ovf = OnOutputQueueOverflow;
+        esp_err_t err = i2s_channel_register_event_callback(tx_handle_, &callbacks, this);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to register output callbacks: %s", esp_err_to_name(err));
+        }
         ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
     }
 
@@ -47,6 +55,27 @@ void AudioCodec::Start() {
     ESP_LOGI(TAG, "Audio codec started");
 }
 
+void AudioCodec::EnableStandby(bool enable) {
+    if (!supports_standby() || enable == standby_) {
+        return;
+    }
+    standby_ = enable;
+    ESP_LOGI(TAG, "Set standby to %s", enable ? "true" : "false");
+}
+
+bool IRAM_ATTR AudioCodec::OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    auto codec = (AudioCodec*)user_ctx;
+    codec->output_buffers_sent_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool IRAM_ATTR AudioCodec::OnOutputQueueOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+    /* The queue of free buffers is full, so the buffer the DMA moves on to holds no new data */
+    auto codec = (AudioCodec*)user_ctx;
+    codec->output_buffers_dry_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
 void AudioCodec::SetOutputVolume(int volume) {
     output_volume_ = volume;
     ESP_LOGI(TAG, "Set output volume to %d", output_volume_);
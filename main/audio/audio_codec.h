@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
 #include <functional>
 
 #include "board.h"
@@ -23,6 +24,11 @@ public:
     virtual void SetInputGain(float gain);
     virtual void EnableInput(bool enable);
     virtual void EnableOutput(bool enable);
+    // Warm standby: while set, disabling input or output keeps the codec configured with the
+    // amplifier off, so enabling it again skips the register setup and the input warm-up.
+    // Ignored by codecs that do not support it, standby() then stays false
+    virtual void EnableStandby(bool enable);
+    virtual bool supports_standby() const { return false; }
 
     virtual void OutputData(std::vector<int16_t>& data);
     virtual bool InputData(std::vector<int16_t>& data);
@@ -38,6 +44,10 @@ public:
     inline float input_gain() const { return input_gain_; }
     inline bool input_enabled() const { return input_enabled_; }
     inline bool output_enabled() const { return output_enabled_; }
+    inline bool standby() const { return standby_; }
+    // Output DMA buffers finished, and buffers the DMA played again because nothing new was written in time
+    inline uint32_t output_buffers_sent() const { return output_buffers_sent_; }
+    inline uint32_t output_buffers_dry() const { return output_buffers_dry_; }
 
 protected:
     i2s_chan_handle_t tx_handle_ = nullptr;
@@ -47,6 +57,7 @@ protected:
     bool input_reference_ = false;
     bool input_enabled_ = false;
     bool output_enabled_ = false;
+    bool standby_ = false;
     int input_sample_rate_ = 0;
     int output_sample_rate_ = 0;
     int input_channels_ = 1;
@@ -56,6 +67,13 @@ protected:
 
     virtual int Read(int16_t* dest, int samples) = 0;
     virtual int Write(const int16_t* data, int samples) = 0;
+
+private:
+    std::atomic<uint32_t> output_buffers_sent_ = 0;
+    std::atomic<uint32_t> output_buffers_dry_ = 0;
+
+    static bool OnOutputSent(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+    static bool OnOutputQueueOverflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
 };
 
 #endif // _AUDIO_CODEC_H
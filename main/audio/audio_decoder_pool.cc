@@ -0,0 +1,56 @@
+#include "audio_decoder_pool.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioDecoderPool"
+
+AudioDecoderPool::AudioDecoderPool(size_t capacity, int output_sample_rate)
+    : entries_(capacity),
+      output_sample_rate_(output_sample_rate) {
+}
+
+AudioDecoderPool::Entry& AudioDecoderPool::Get(int sample_rate, int frame_duration) {
+    Entry* oldest = &entries_[0];
+    for (auto& entry : entries_) {
+        if (entry.decoder == nullptr) {
+            if (oldest->decoder != nullptr) {
+                oldest = &entry;
+            }
+            continue;
+        }
+        if (entry.decoder->sample_rate() == sample_rate && entry.decoder->duration_ms() == frame_duration) {
+            entry.last_used = ++use_count_;
+            return entry;
+        }
+        if (oldest->decoder != nullptr && entry.last_used < oldest->last_used) {
+            oldest = &entry;
+        }
+    }
+
+    /* Take an empty slot, or the least recently used one */
+    oldest->decoder.reset();
+    oldest->decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    if (sample_rate != output_sample_rate_) {
+        if (oldest->resampler == nullptr) {
+            oldest->resampler = std::make_unique<PcmResampler>();
+        }
+        oldest->resampler->Configure(sample_rate, output_sample_rate_);
+    } else {
+        oldest->resampler.reset();
+    }
+    oldest->last_used = ++use_count_;
+    ESP_LOGI(TAG, "Created decoder %d Hz %d ms, output %d Hz", sample_rate, frame_duration, output_sample_rate_);
+    return *oldest;
+}
+
+void AudioDecoderPool::ResetState() {
+    for (auto& entry : entries_) {
+        if (entry.decoder == nullptr) {
+            continue;
+        }
+        entry.decoder->ResetState();
+        if (entry.resampler != nullptr) {
+            entry.resampler->Reset();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef AUDIO_DECODER_POOL_H
+#define AUDIO_DECODER_POOL_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <opus_decoder.h>
+
+#include "pcm_resampler.h"
+
+/*
+ * Opus decoders and output resamplers kept ready, keyed by (sample rate, frame duration).
+ *
+ * The downlink changes configuration between sessions (negotiated frame duration, server
+ * sample rate) and for the 16 kHz audio testing playback. Instead of destroying and
+ * recreating the decoder on every switch, each stream configuration keeps its own decoder
+ * and resampler, so switching back costs no allocation and the decoder keeps its state.
+ * When the pool is full, the least recently used entry is recreated for the new
+ * configuration.
+ *
+ * The class is not thread safe, it belongs to the task that decodes.
+ */
+class AudioDecoderPool {
+public:
+    struct Entry {
+        std::unique_ptr<OpusDecoderWrapper> decoder;
+        // nullptr when the decoder already runs at the output rate
+        std::unique_ptr<PcmResampler> resampler;
+        uint32_t last_used = 0;
+    };
+
+    AudioDecoderPool(size_t capacity, int output_sample_rate);
+
+    // Decoder for the configuration, created on first use
+    Entry& Get(int sample_rate, int frame_duration);
+    // Resets every decoder and resampler when the downlink stream restarts, on the decoding task like Get()
+    void ResetState();
+
+private:
+    std::vector<Entry> entries_;
+    const int output_sample_rate_;
+    uint32_t use_count_ = 0;
+};
+
+#endif // AUDIO_DECODER_POOL_H
@@ -0,0 +1,59 @@
+#include "audio_encoder_controller.h"
+
+#include <algorithm>
+#include <esp_log.h>
+
+#define TAG "AudioEncoderController"
+
+// Share of the frame time the encoder may use before the complexity is lowered
+#define ENCODE_LOAD_HIGH_PERCENT 40
+// Share of the frame time below which the complexity is raised again
+#define ENCODE_LOAD_LOW_PERCENT 15
+
+AudioEncoderController::AudioEncoderController(int max_complexity, int window_ms, int congested_queue_ms)
+    : max_complexity_(max_complexity),
+      window_ms_(window_ms),
+      congested_queue_ms_(congested_queue_ms) {
+}
+
+void AudioEncoderController::Reset() {
+    settings_ = Settings();
+    congested_ = false;
+    window_elapsed_ms_ = 0;
+    window_encode_us_ = 0;
+    window_max_queue_ms_ = 0;
+    send_failures_ = 0;
+}
+
+void AudioEncoderController::ReportSendFailure() {
+    send_failures_++;
+}
+
+bool AudioEncoderController::OnFrameEncoded(int frame_duration_ms, uint32_t encode_time_us, int send_queue_ms, bool voice) {
+    Settings previous = settings_;
+    window_elapsed_ms_ += frame_duration_ms;
+    window_encode_us_ += encode_time_us;
+    window_max_queue_ms_ = std::max(window_max_queue_ms_, send_queue_ms);
+
+    if (window_elapsed_ms_ >= window_ms_) {
+        uint32_t failures = send_failures_.exchange(0);
+        int load_percent = window_encode_us_ * 100 / (window_elapsed_ms_ * 1000);
+        congested_ = failures > 0 || window_max_queue_ms_ >= congested_queue_ms_;
+        if (load_percent > ENCODE_LOAD_HIGH_PERCENT && settings_.complexity > 0) {
+            settings_.complexity--;
+        } else if (load_percent < ENCODE_LOAD_LOW_PERCENT && !congested_ && settings_.complexity < max_complexity_) {
+            settings_.complexity++;
+        }
+        ESP_LOGD(TAG, "Encode load %d%%, send queue max %d ms, failures %lu",
+            load_percent, window_max_queue_ms_, failures);
+        window_elapsed_ms_ = 0;
+        window_encode_us_ = 0;
+        window_max_queue_ms_ = 0;
+    }
+
+    settings_.dtx = congested_ || !voice;
+    if (settings_.complexity != previous.complexity) {
+        ESP_LOGI(TAG, "Opus encoder complexity %d -> %d", previous.complexity, settings_.complexity);
+    }
+    return settings_.complexity != previous.complexity || settings_.dtx != previous.dtx;
+}
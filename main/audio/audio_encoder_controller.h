@@ -0,0 +1,48 @@
+#ifndef AUDIO_ENCODER_CONTROLLER_H
+#define AUDIO_ENCODER_CONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Picks the uplink Opus encoder settings from network and CPU feedback
+ * (CONFIG_USE_ADAPTIVE_OPUS_ENCODER).
+ *
+ * The encode task reports every frame it encodes: its encode time, the depth of the send
+ * queue and whether the audio processor currently hears voice. Once per window the
+ * controller raises the complexity while the encoder uses little of the frame time, and
+ * lowers it when encoding gets expensive. DTX is on while the processor reports silence,
+ * and stays on for the whole next window after a congested one, i.e. a deep send queue or
+ * a failed send.
+ *
+ * Only the encode task calls OnFrameEncoded(), ReportSendFailure() may be called from any task.
+ */
+class AudioEncoderController {
+public:
+    struct Settings {
+        int complexity = 0;
+        bool dtx = false;
+    };
+
+    AudioEncoderController(int max_complexity, int window_ms, int congested_queue_ms);
+
+    void Reset();
+    void ReportSendFailure();
+    // Returns true if the settings changed and have to be applied to the encoder
+    bool OnFrameEncoded(int frame_duration_ms, uint32_t encode_time_us, int send_queue_ms, bool voice);
+
+    inline const Settings& settings() const { return settings_; }
+
+private:
+    const int max_complexity_;
+    const int window_ms_;
+    const int congested_queue_ms_;
+    Settings settings_;
+    bool congested_ = false;
+    int window_elapsed_ms_ = 0;
+    uint64_t window_encode_us_ = 0;
+    int window_max_queue_ms_ = 0;
+    std::atomic<uint32_t> send_failures_ = 0;
+};
+
+#endif // AUDIO_ENCODER_CONTROLLER_H
@@ -0,0 +1,56 @@
+#include "audio_endpoint_detector.h"
+
+#include <algorithm>
+#include <esp_log.h>
+
+#define TAG "AudioEndpointDetector"
+
+AudioEndpointDetector::AudioEndpointDetector(int hangover_ms, int min_speech_ms, int min_confidence)
+    : hangover_ms_(hangover_ms),
+      min_speech_ms_(min_speech_ms),
+      min_confidence_(min_confidence) {
+}
+
+void AudioEndpointDetector::Reset() {
+    reset_requested_ = true;
+}
+
+bool AudioEndpointDetector::OnFrame(int frame_duration_ms, bool voice) {
+    if (reset_requested_.exchange(false)) {
+        ended_ = false;
+        utterance_ms_ = 0;
+        voice_ms_ = 0;
+        silence_ms_ = 0;
+        confidence_ = 0;
+    }
+    if (ended_ || (utterance_ms_ == 0 && !voice)) {
+        return false;
+    }
+
+    utterance_ms_ += frame_duration_ms;
+    if (voice) {
+        voice_ms_ += frame_duration_ms;
+        silence_ms_ = 0;
+        return false;
+    }
+    silence_ms_ += frame_duration_ms;
+    if (silence_ms_ < hangover_ms_) {
+        return false;
+    }
+
+    /* The trailing silence is not part of the utterance */
+    int spoken_ms = std::max(utterance_ms_ - silence_ms_, 1);
+    int length_percent = std::min(100, voice_ms_ * 100 / (2 * std::max(min_speech_ms_, 1)));
+    confidence_ = std::min(100, voice_ms_ * 100 / spoken_ms) * length_percent / 100;
+    bool ended = voice_ms_ >= min_speech_ms_ && confidence_ >= min_confidence_;
+    ESP_LOGI(TAG, "Utterance of %d ms, %d ms voiced, confidence %d%%%s", spoken_ms, voice_ms_, confidence_,
+        ended ? "" : ", ignored");
+    if (ended) {
+        ended_ = true;
+    } else {
+        utterance_ms_ = 0;
+        voice_ms_ = 0;
+        silence_ms_ = 0;
+    }
+    return ended;
+}
@@ -0,0 +1,41 @@
+#ifndef AUDIO_ENDPOINT_DETECTOR_H
+#define AUDIO_ENDPOINT_DETECTOR_H
+
+#include <atomic>
+
+/*
+ * Decides on the device that the user has finished speaking (CONFIG_USE_DEVICE_ENDPOINTING).
+ *
+ * The audio processor output reports every frame with the current VAD state. An utterance
+ * starts at the first voiced frame and ends once the VAD has been silent for the hangover
+ * time. Utterances with less voice than the minimum speech length are dropped as noise.
+ * The others get a confidence from 0 to 100, the voiced share of the utterance scaled down
+ * for utterances shorter than twice the minimum speech length, and only one reaching the
+ * minimum confidence ends the turn. Anything less is left to the server.
+ *
+ * OnFrame() is called from the task that runs the audio processor output, Reset() may be
+ * called from any task and takes effect on the next frame.
+ */
+class AudioEndpointDetector {
+public:
+    AudioEndpointDetector(int hangover_ms, int min_speech_ms, int min_confidence);
+
+    void Reset();
+    // Returns true once per reset, when an utterance ended with enough confidence
+    bool OnFrame(int frame_duration_ms, bool voice);
+
+    inline int confidence() const { return confidence_; }
+
+private:
+    const int hangover_ms_;
+    const int min_speech_ms_;
+    const int min_confidence_;
+    std::atomic<bool> reset_requested_ = true;
+    bool ended_ = false;
+    int utterance_ms_ = 0;
+    int voice_ms_ = 0;
+    int silence_ms_ = 0;
+    int confidence_ = 0;
+};
+
+#endif // AUDIO_ENDPOINT_DETECTOR_H
@@ -0,0 +1,181 @@
+#include "audio_jitter_buffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+AudioJitterBuffer::AudioJitterBuffer(size_t capacity, int min_depth, int max_delay_ms, int max_conceal_frames)
+    : slots_(capacity),
+      min_depth_(min_depth),
+      max_delay_ms_(max_delay_ms),
+      max_conceal_frames_(max_conceal_frames) {
+    target_depth_ = min_depth_;
+}
+
+void AudioJitterBuffer::Reset() {
+    for (auto& slot : slots_) {
+        slot.reset();
+    }
+    count_ = 0;
+    started_ = false;
+    playing_ = false;
+    has_played_ = false;
+    concealed_in_row_ = 0;
+    // Keep the jitter estimate, it describes the link rather than the stream
+    has_transit_ = false;
+}
+
+bool AudioJitterBuffer::Push(AudioStreamPacketPtr packet, int64_t now_ms) {
+    const int32_t capacity = slots_.size();
+    uint32_t sequence = packet->sequence;
+    if (packet->frame_duration > 0) {
+        frame_duration_ms_ = packet->frame_duration;
+    }
+    statistics_.received++;
+
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence;
+    } else {
+        int32_t offset = (int32_t)(sequence - next_sequence_);
+        if (offset <= -capacity * 4 || offset >= capacity * 4) {
+            // The server restarted its sequence numbers, start over
+            Reset();
+            return Push(std::move(packet), now_ms);
+        }
+        if (offset < 0) {
+            if (!has_played_ && (int32_t)(highest_sequence_ - sequence) < capacity) {
+                // Still prefilling the first packets, an earlier one arrived after a later one
+                next_sequence_ = sequence;
+            } else {
+                statistics_.late++;
+                return false;
+            }
+        }
+        while ((int32_t)(sequence - next_sequence_) >= capacity) {
+            // Too far ahead of the playout point, drop the oldest packets to make room
+            auto& oldest = Slot(next_sequence_);
+            if (oldest) {
+                oldest.reset();
+                count_--;
+            }
+            next_sequence_++;
+            statistics_.skipped++;
+        }
+    }
+
+    auto& slot = Slot(sequence);
+    if (slot) {
+        statistics_.duplicated++;
+        return false;
+    }
+
+    if ((int32_t)(sequence - highest_sequence_) < 0) {
+        statistics_.reordered++;
+    } else {
+        highest_sequence_ = sequence;
+    }
+    UpdateJitter(sequence, now_ms);
+
+    if (playing_ && count_ == 0 && now_ms - last_pop_ms_ >= frame_duration_ms_) {
+        // The buffer ran dry, build up the target depth again before resuming
+        playing_ = false;
+        statistics_.rebuffers++;
+    }
+    if (!playing_ && count_ == 0) {
+        // Start (re)buffering
+        prefill_start_ms_ = now_ms;
+        UpdateTargetDepth();
+    }
+    slot = std::move(packet);
+    count_++;
+    return true;
+}
+
+void AudioJitterBuffer::UpdateJitter(uint32_t sequence, int64_t now_ms) {
+    // Relative transit time, the sender clock is derived from the sequence number
+    int64_t transit_us = now_ms * 1000 - (int64_t)sequence * frame_duration_ms_ * 1000;
+    if (has_transit_) {
+        int64_t d = std::llabs(transit_us - last_transit_us_);
+        jitter_us_ += (d - jitter_us_) / 16;
+    }
+    last_transit_us_ = transit_us;
+    has_transit_ = true;
+}
+
+void AudioJitterBuffer::UpdateTargetDepth() {
+    int64_t frame_us = (int64_t)frame_duration_ms_ * 1000;
+    int depth = 1 + (int)((2 * jitter_us_ + frame_us - 1) / frame_us);
+    int max_depth = std::max(min_depth_, max_delay_ms_ / frame_duration_ms_);
+    target_depth_ = std::clamp(depth, min_depth_, max_depth);
+}
+
+bool AudioJitterBuffer::IsReady(int64_t now_ms, bool urgent) const {
+    if (count_ == 0) {
+        return false;
+    }
+    if (playing_) {
+        return urgent || slots_[next_sequence_ % slots_.size()] != nullptr;
+    }
+    return (int)count_ >= target_depth_ || now_ms - prefill_start_ms_ >= (int64_t)target_depth_ * frame_duration_ms_;
+}
+
+int AudioJitterBuffer::GetWaitTime(int64_t now_ms) const {
+    if (count_ == 0 || playing_) {
+        return -1;
+    }
+    int64_t deadline = prefill_start_ms_ + (int64_t)target_depth_ * frame_duration_ms_;
+    return std::max<int64_t>(0, deadline - now_ms);
+}
+
+void AudioJitterBuffer::SkipToNextPacket() {
+    while (!Slot(next_sequence_)) {
+        next_sequence_++;
+        statistics_.skipped++;
+    }
+    concealed_in_row_ = 0;
+}
+
+AudioJitterBuffer::PopResult AudioJitterBuffer::Pop(AudioStreamPacketPtr& packet, int64_t now_ms, bool urgent) {
+    if (count_ == 0) {
+        return kPopNone;
+    }
+
+    if (!playing_) {
+        if (!IsReady(now_ms, urgent)) {
+            return kPopNone;
+        }
+        playing_ = true;
+        has_played_ = true;
+        if (!Slot(next_sequence_)) {
+            // Nothing to conceal across a pause, start from the oldest packet we have
+            SkipToNextPacket();
+        }
+        concealed_in_row_ = 0;
+    }
+
+    auto& slot = Slot(next_sequence_);
+    if (!slot) {
+        if (!urgent) {
+            // Give the missing packet more time while the output still has audio queued
+            return kPopNone;
+        }
+        if (concealed_in_row_ >= max_conceal_frames_) {
+            // Too long a gap to conceal, jump to the next packet we have
+            SkipToNextPacket();
+        } else {
+            next_sequence_++;
+            concealed_in_row_++;
+            statistics_.concealed++;
+            last_pop_ms_ = now_ms;
+            return kPopLost;
+        }
+    }
+
+    packet = std::move(Slot(next_sequence_));
+    count_--;
+    next_sequence_++;
+    concealed_in_row_ = 0;
+    last_pop_ms_ = now_ms;
+    return kPopPacket;
+}
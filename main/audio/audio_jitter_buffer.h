@@ -0,0 +1,86 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+
+#include "protocol.h"
+
+/*
+ * Reordering jitter buffer for sequenced server audio (MQTT + UDP).
+ *
+ * Packets are stored in a fixed ring indexed by sequence number, so late packets are put
+ * back in order without allocating. Playback starts once the buffered depth reaches a target
+ * that follows the measured inter-arrival jitter (RFC 3550 style estimator). When the next
+ * packet is still missing at the moment the decoder has to produce audio, Pop() reports a
+ * loss so the caller can run Opus packet loss concealment instead of leaving a gap.
+ *
+ * The class is not thread safe and takes the clock as a parameter, so it can be driven by
+ * recorded packet traces off-device.
+ */
+class AudioJitterBuffer {
+public:
+    enum PopResult {
+        kPopNone,       // Nothing to play yet (empty or still prefilling)
+        kPopPacket,     // `packet` holds the next packet in sequence
+        kPopLost,       // The next packet is missing, conceal one frame
+    };
+
+    struct Statistics {
+        uint32_t received = 0;
+        uint32_t reordered = 0;
+        uint32_t late = 0;
+        uint32_t duplicated = 0;
+        uint32_t concealed = 0;
+        uint32_t skipped = 0;
+        uint32_t rebuffers = 0;
+    };
+
+    AudioJitterBuffer(size_t capacity, int min_depth, int max_delay_ms, int max_conceal_frames);
+
+    void Reset();
+    bool Push(AudioStreamPacketPtr packet, int64_t now_ms);
+    // `urgent` means the output is about to run dry, a missing packet is concealed instead of waited for
+    PopResult Pop(AudioStreamPacketPtr& packet, int64_t now_ms, bool urgent);
+    // True if Pop() with the same arguments would return something
+    bool IsReady(int64_t now_ms, bool urgent) const;
+    // Milliseconds until IsReady() may change without a new packet, -1 if only a push can change it
+    int GetWaitTime(int64_t now_ms) const;
+
+    inline size_t size() const { return count_; }
+    inline int target_depth() const { return target_depth_; }
+    inline int jitter_ms() const { return jitter_us_ / 1000; }
+    inline const Statistics& statistics() const { return statistics_; }
+
+private:
+    std::vector<AudioStreamPacketPtr> slots_;
+    const int min_depth_;
+    const int max_delay_ms_;
+    const int max_conceal_frames_;
+
+    size_t count_ = 0;
+    bool started_ = false;
+    bool playing_ = false;
+    bool has_played_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    int frame_duration_ms_ = 60;
+    int concealed_in_row_ = 0;
+    int target_depth_ = 1;
+    int64_t prefill_start_ms_ = 0;
+    int64_t last_pop_ms_ = 0;
+
+    // Jitter estimator state
+    bool has_transit_ = false;
+    int64_t last_transit_us_ = 0;
+    int64_t jitter_us_ = 0;
+
+    Statistics statistics_;
+
+    inline AudioStreamPacketPtr& Slot(uint32_t sequence) { return slots_[sequence % slots_.size()]; }
+    void UpdateJitter(uint32_t sequence, int64_t now_ms);
+    void UpdateTargetDepth();
+    void SkipToNextPacket();
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
@@ -0,0 +1,58 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <cstdint>
+
+/*
+ * Per-stage latency of the audio pipeline.
+ *
+ * Frames carry the time their previous stage finished (AudioTask::time_us,
+ * AudioStreamPacket::time_us), every stage records how long the frame waited
+ * and was processed since then. Each stage is recorded by a single task.
+ */
+enum AudioLatencyStage {
+    kAudioLatencyCapture,       // Microphone read -> audio processor output
+    kAudioLatencyEncode,        // Audio processor output -> Opus packet
+    kAudioLatencySend,          // Opus packet -> handed to the network
+    kAudioLatencyDecode,        // Network receive -> decoded PCM (includes queueing and jitter buffer)
+    kAudioLatencyPlayback,      // Decoded PCM -> written to the codec
+    kAudioLatencyStageCount,
+};
+
+// Upper bound of each bucket in milliseconds, the last bucket is open
+#define AUDIO_LATENCY_BUCKET_BOUNDS_MS {5, 10, 20, 40, 80, 160, 320}
+#define AUDIO_LATENCY_BUCKETS 8
+
+struct AudioLatencyHistogram {
+    uint32_t count = 0;
+    uint64_t total_us = 0;
+    uint32_t max_us = 0;
+    uint32_t buckets[AUDIO_LATENCY_BUCKETS] = {};
+
+    void Record(int64_t elapsed_us) {
+        static const uint32_t bounds_ms[] = AUDIO_LATENCY_BUCKET_BOUNDS_MS;
+        if (elapsed_us < 0) {
+            elapsed_us = 0;
+        }
+        uint32_t elapsed = elapsed_us;
+        int bucket = 0;
+        while (bucket < AUDIO_LATENCY_BUCKETS - 1 && elapsed >= bounds_ms[bucket] * 1000) {
+            bucket++;
+        }
+        buckets[bucket]++;
+        count++;
+        total_us += elapsed;
+        if (elapsed > max_us) {
+            max_us = elapsed;
+        }
+    }
+
+    inline uint32_t average_us() const { return count ? total_us / count : 0; }
+};
+
+inline const char* AudioLatencyStageName(int stage) {
+    static const char* names[] = {"capture", "encode", "send", "decode", "playback"};
+    return stage >= 0 && stage < kAudioLatencyStageCount ? names[stage] : "unknown";
+}
+
+#endif // AUDIO_LATENCY_H
@@ -0,0 +1,50 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+
+static inline int16_t Saturate(int32_t value) {
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+}
+
+void AudioMixer::Configure(int sample_rate, int duck_percent, int ramp_ms) {
+    duck_gain_ = AUDIO_MIXER_UNITY_GAIN * std::clamp(duck_percent, 0, 100) / 100;
+    int ramp_samples = std::max(1, sample_rate * ramp_ms / 1000);
+    ramp_step_ = std::max(1, AUDIO_MIXER_UNITY_GAIN / ramp_samples);
+    stream_gain_ = AUDIO_MIXER_UNITY_GAIN;
+}
+
+void AudioMixer::Reset() {
+    stream_gain_ = AUDIO_MIXER_UNITY_GAIN;
+}
+
+void AudioMixer::ApplyStreamGain(int16_t* pcm, size_t samples, bool ducked) {
+    int32_t target = ducked ? duck_gain_ : AUDIO_MIXER_UNITY_GAIN;
+    size_t i = 0;
+    /* Ramp sample by sample until the target is reached */
+    for (; i < samples && stream_gain_ != target; i++) {
+        if (stream_gain_ < target) {
+            stream_gain_ = std::min(stream_gain_ + ramp_step_, target);
+        } else {
+            stream_gain_ = std::max(stream_gain_ - ramp_step_, target);
+        }
+        pcm[i] = (int32_t(pcm[i]) * stream_gain_) >> 15;
+    }
+    if (stream_gain_ == AUDIO_MIXER_UNITY_GAIN) {
+        return;
+    }
+    for (; i < samples; i++) {
+        pcm[i] = (int32_t(pcm[i]) * stream_gain_) >> 15;
+    }
+}
+
+void AudioMixer::Mix(int16_t* pcm, const int16_t* source, size_t samples, int32_t gain) {
+    if (gain == AUDIO_MIXER_UNITY_GAIN) {
+        for (size_t i = 0; i < samples; i++) {
+            pcm[i] = Saturate(int32_t(pcm[i]) + source[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = Saturate(int32_t(pcm[i]) + ((int32_t(source[i]) * gain) >> 15));
+    }
+}
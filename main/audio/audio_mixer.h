@@ -0,0 +1,35 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define AUDIO_MIXER_UNITY_GAIN 32768
+
+/*
+ * Mixing stage in front of AudioCodec::OutputData.
+ *
+ * The output task plays the decoded stream (server audio, uncached sounds) and adds the
+ * alert source (cached system sounds) on top of it, so an alert no longer waits for the
+ * speech queued before it. While an alert plays, the stream is ducked to `duck_percent`.
+ * Gains move in a short linear ramp so ducking does not click.
+ *
+ * Gains are Q15, AUDIO_MIXER_UNITY_GAIN is 1.0. The class is not thread safe, it belongs to the output task.
+ */
+class AudioMixer {
+public:
+    void Configure(int sample_rate, int duck_percent, int ramp_ms);
+    void Reset();
+
+    // Scales the stream in `pcm`, ramping towards the duck gain while `ducked`, back to unity otherwise
+    void ApplyStreamGain(int16_t* pcm, size_t samples, bool ducked);
+    // Adds `source` scaled by `gain` into `pcm`, saturating to 16 bits
+    static void Mix(int16_t* pcm, const int16_t* source, size_t samples, int32_t gain);
+
+private:
+    int32_t duck_gain_ = AUDIO_MIXER_UNITY_GAIN;
+    int32_t stream_gain_ = AUDIO_MIXER_UNITY_GAIN;
+    int32_t ramp_step_ = AUDIO_MIXER_UNITY_GAIN;
+};
+
+#endif // AUDIO_MIXER_H
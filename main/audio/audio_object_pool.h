@@ -0,0 +1,96 @@
+#ifndef AUDIO_OBJECT_POOL_H
+#define AUDIO_OBJECT_POOL_H
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+/*
+ * Fixed-size slab of preallocated audio objects (packets, PCM tasks).
+ *
+ * Acquire() hands out an object from the slab, the returned pointer gives it back
+ * through its deleter instead of freeing it, so the payload buffers keep their
+ * capacity and the hot path stops allocating once every slot has been used once.
+ * When the slab is exhausted (or not initialized yet) Acquire() falls back to the heap.
+ */
+template <typename T>
+class AudioObjectPool {
+public:
+    struct Deleter {
+        AudioObjectPool* pool = nullptr;
+
+        void operator()(T* object) const {
+            if (pool != nullptr) {
+                pool->Release(object);
+            } else {
+                delete object;
+            }
+        }
+    };
+    using Ptr = std::unique_ptr<T, Deleter>;
+
+    static AudioObjectPool& GetInstance() {
+        static AudioObjectPool instance;
+        return instance;
+    }
+
+    // Allocate the slab once, `recycle` resets an object before it goes back to the free list
+    void Initialize(size_t count, std::function<void(T&)> prepare, std::function<void(T&)> recycle) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!slab_.empty()) {
+            return;
+        }
+        recycle_ = recycle;
+        slab_.resize(count);
+        free_list_.reserve(count);
+        for (auto& object : slab_) {
+            if (prepare) {
+                prepare(object);
+            }
+            free_list_.push_back(&object);
+        }
+    }
+
+    Ptr Acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_list_.empty()) {
+                T* object = free_list_.back();
+                free_list_.pop_back();
+                return Ptr(object, Deleter{this});
+            }
+            if (!slab_.empty()) {
+                heap_fallbacks_++;
+            }
+        }
+        return Ptr(new T(), Deleter{nullptr});
+    }
+
+    size_t available() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_list_.size();
+    }
+
+    inline size_t capacity() const { return slab_.size(); }
+    inline size_t heap_fallbacks() const { return heap_fallbacks_; }
+
+private:
+    std::mutex mutex_;
+    std::vector<T> slab_;
+    std::vector<T*> free_list_;
+    std::function<void(T&)> recycle_;
+    size_t heap_fallbacks_ = 0;
+
+    AudioObjectPool() = default;
+
+    void Release(T* object) {
+        if (recycle_) {
+            recycle_(*object);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_list_.push_back(object);
+    }
+};
+
+#endif // AUDIO_OBJECT_POOL_H
@@ -0,0 +1,83 @@
+#ifndef AUDIO_PLAYBACK_CLOCK_H
+#define AUDIO_PLAYBACK_CLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <algorithm>
+
+#define AUDIO_PLAYBACK_CLOCK_SEGMENTS 32
+
+/*
+ * Tracks which server timestamp is at the speaker, for server-side AEC.
+ *
+ * The output task reports every write to the codec. A write returns once its samples are
+ * queued behind at most `dma_frames` frames of I2S DMA, so the last written sample leaves
+ * the DAC about one DMA depth later (sooner if the DMA had run dry). Each write becomes a
+ * segment of the play schedule, and GetTimestamp() interpolates inside the segment that
+ * was playing at a given time, so an uplink frame can be stamped with the downlink audio
+ * that was echoing while it was captured.
+ */
+class AudioPlaybackClock {
+public:
+    void Configure(int sample_rate, int dma_frames) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sample_rate_ = sample_rate;
+        dma_latency_us_ = int64_t(dma_frames) * 1000000 / sample_rate;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count_ = 0;
+        play_end_us_ = 0;
+    }
+
+    // `samples` frames starting at server `timestamp` (ms, 0 if none) were written at `time_us`
+    void OnWritten(uint32_t timestamp, size_t samples, int64_t time_us) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t duration_us = int64_t(samples) * 1000000 / sample_rate_;
+        int64_t play_end_us = std::min(time_us + dma_latency_us_, std::max(play_end_us_, time_us) + duration_us);
+        auto& segment = segments_[head_];
+        segment.play_start_us = play_end_us - duration_us;
+        segment.play_end_us = play_end_us;
+        segment.timestamp = timestamp;
+        head_ = (head_ + 1) % AUDIO_PLAYBACK_CLOCK_SEGMENTS;
+        count_ = std::min(count_ + 1, AUDIO_PLAYBACK_CLOCK_SEGMENTS);
+        play_end_us_ = play_end_us;
+    }
+
+    // Server timestamp (ms) of the audio at the DAC at `time_us`, 0 if no server audio was playing
+    uint32_t GetTimestamp(int64_t time_us) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 1; i <= count_; i++) {
+            auto& segment = segments_[(head_ + AUDIO_PLAYBACK_CLOCK_SEGMENTS - i) % AUDIO_PLAYBACK_CLOCK_SEGMENTS];
+            if (time_us >= segment.play_end_us) {
+                return 0;
+            }
+            if (time_us >= segment.play_start_us) {
+                if (segment.timestamp == 0) {
+                    return 0;
+                }
+                return segment.timestamp + uint32_t((time_us - segment.play_start_us) / 1000);
+            }
+        }
+        return 0;
+    }
+
+private:
+    struct Segment {
+        int64_t play_start_us;
+        int64_t play_end_us;
+        uint32_t timestamp;
+    };
+
+    std::mutex mutex_;
+    int sample_rate_ = 16000;
+    int64_t dma_latency_us_ = 0;
+    Segment segments_[AUDIO_PLAYBACK_CLOCK_SEGMENTS];
+    int head_ = 0;
+    int count_ = 0;
+    int64_t play_end_us_ = 0;
+};
+
+#endif // AUDIO_PLAYBACK_CLOCK_H
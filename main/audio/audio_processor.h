@@ -13,6 +13,8 @@ public:
     virtual ~AudioProcessor() = default;
     
     virtual void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) = 0;
+    // Change the size of the frames passed to OnOutput, takes effect on the next output
+    virtual void SetFrameDuration(int frame_duration_ms) = 0;
     virtual void Feed(std::vector<int16_t>&& data) = 0;
     virtual void Start() = 0;
     virtual void Stop() = 0;
@@ -1,9 +1,14 @@
 #include "audio_service.h"
+#include "pcm_interleave.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cstring>
+#include <algorithm>
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
+#elif CONFIG_USE_LITE_AUDIO_PROCESSOR
+#include "processors/lite_audio_processor.h"
 #else
 #include "processors/no_audio_processor.h"
 #endif
@@ -18,7 +23,20 @@
 #define TAG "AudioService"
 
 
-AudioService::AudioService() {
+AudioService::AudioService()
+    : audio_decode_queue_(std::max(MAX_DECODE_PACKETS_IN_QUEUE, MAX_TESTING_PACKETS_IN_QUEUE)),
+      audio_send_queue_(MAX_SEND_PACKETS_IN_QUEUE),
+      audio_testing_queue_(MAX_TESTING_PACKETS_IN_QUEUE),
+      audio_encode_queue_(MAX_ENCODE_TASKS_IN_QUEUE),
+      audio_playback_queue_(MAX_PLAYBACK_TASKS_IN_QUEUE),
+      sound_queue_(MAX_SOUNDS_IN_QUEUE),
+      mixer_sound_queue_(MAX_SOUNDS_IN_QUEUE),
+      sound_playback_queue_(MAX_SOUND_PLAYBACK_TASKS_IN_QUEUE),
+      jitter_buffer_(MAX_DECODE_PACKETS_IN_QUEUE, JITTER_BUFFER_MIN_DEPTH, JITTER_BUFFER_MAX_DELAY_MS, JITTER_BUFFER_MAX_CONCEAL_FRAMES),
+      encoder_controller_(ADAPTIVE_ENCODER_MAX_COMPLEXITY, ADAPTIVE_ENCODER_WINDOW_MS, ADAPTIVE_ENCODER_CONGESTED_QUEUE_MS),
+      endpoint_detector_(ENDPOINT_HANGOVER_MS, ENDPOINT_MIN_SPEECH_MS, ENDPOINT_MIN_CONFIDENCE),
+      reference_aligner_(AEC_REFERENCE_MAX_DELAY_MS, AEC_REFERENCE_LEAD_MS),
+      mic_beamformer_(MIC_BEAMFORMER_TAPS, MIC_BEAMFORMER_STEP, MIC_BEAMFORMER_ADAPT_RATIO) {
     event_group_ = xEventGroupCreate();
 }
 
@@ -34,23 +52,81 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    decoder_pool_ = std::make_unique<AudioDecoderPool>(OPUS_DECODER_POOL_SIZE, codec->output_sample_rate());
+    SetDecodeSampleRate(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_ms_);
+    ApplyEncoderSettings();
+    mixer_.Configure(codec->output_sample_rate(), ALERT_DUCKING_PERCENT, ALERT_DUCKING_RAMP_MS);
+    sound_demuxer_.OnPacket([this](const uint8_t* data, size_t size) {
+        int frame_duration = OggDemuxer::GetOpusPacketDuration(data, size);
+        if (frame_duration == 0 || frame_duration > MAX_OPUS_FRAME_DURATION_MS) {
+            ESP_LOGW(TAG, "Skip Opus packet with unsupported duration: %d ms", frame_duration);
+            return;
+        }
+        sound_frame_duration_ = frame_duration;
+        sound_packet_.assign(data, data + size);
+    });
+    output_dma_latency_us_ = int64_t(AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM) * 1000000 / codec->output_sample_rate();
+#if CONFIG_USE_SERVER_AEC
+    playback_clock_.Configure(codec->output_sample_rate(), AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM);
+#endif
+
+    /* Preallocate the packets and PCM buffers used on the hot path */
+    AudioStreamPacketPool::GetInstance().Initialize(MAX_AUDIO_PACKETS_IN_POOL, nullptr, [](AudioStreamPacket& packet) {
+        packet.sample_rate = 0;
+        packet.frame_duration = 0;
+        packet.timestamp = 0;
+        packet.sequence = 0;
+        packet.time_us = 0;
+        packet.payload.clear();
+    });
+    int max_frame_samples = std::max(16000, codec->output_sample_rate()) * OPUS_FRAME_DURATION_MS / 1000;
+    AudioTaskPool::GetInstance().Initialize(MAX_AUDIO_TASKS_IN_POOL, [max_frame_samples](AudioTask& task) {
+        task.pcm.reserve(max_frame_samples);
+    }, [](AudioTask& task) {
+        task.timestamp = 0;
+        task.time_us = 0;
+        task.pcm.clear();
+    });
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
         reference_resampler_.Configure(codec->input_sample_rate(), 16000);
     }
 
-#if CONFIG_USE_AUDIO_PROCESSOR
+#if CONFIG_USE_SHARED_AFE
+    afe_front_end_ = std::make_unique<AfeFrontEnd>();
+    audio_processor_ = std::make_unique<AfeAudioProcessor>(afe_front_end_.get());
+#elif CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
+#elif CONFIG_USE_LITE_AUDIO_PROCESSOR
+    audio_processor_ = std::make_unique<LiteAudioProcessor>();
 #else
     audio_processor_ = std::make_unique<NoAudioProcessor>();
 #endif
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+        /* The last output sample was captured before everything the processor still holds */
+        processor_output_samples_ += data.size();
+        int32_t held_samples = std::max<int32_t>(0, processor_input_samples_ - processor_output_samples_);
+        int64_t captured_us = last_capture_time_us_ - held_samples * 1000000LL / 16000;
+        RecordLatency(kAudioLatencyCapture, captured_us);
+#if CONFIG_USE_SERVER_AEC
+        /* Stamp the frame with the server audio that was at the speaker when its first sample was captured */
+        uint32_t timestamp = playback_clock_.GetTimestamp(captured_us - int64_t(data.size()) * 1000000 / 16000);
+#else
+        uint32_t timestamp = 0;
+#endif
+#if CONFIG_USE_DEVICE_ENDPOINTING
+        int frame_duration_ms = data.size() * 1000 / 16000;
+#endif
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data), timestamp);
+#if CONFIG_USE_DEVICE_ENDPOINTING
+        /* The frames still in the encoder are hangover silence, the stop message may overtake them */
+        if (endpoint_detector_.OnFrame(frame_duration_ms, voice_detected_) && callbacks_.on_utterance_end) {
+            callbacks_.on_utterance_end(endpoint_detector_.confidence());
+        }
+#endif
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -109,12 +185,27 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 4, &audio_output_task_handle_);
 #endif
 
+#if CONFIG_USE_SEPARATE_OPUS_CODEC_TASKS
+    /* Start independent opus decode / encode workers on different cores */
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusCodecTask(true, false);
+        vTaskDelete(NULL);
+    }, "opus_decode", 2048 * 6, this, OPUS_DECODE_TASK_PRIORITY, &opus_codec_task_handle_, OPUS_DECODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusCodecTask(false, true);
+        vTaskDelete(NULL);
+    }, "opus_encode", 2048 * 12, this, OPUS_ENCODE_TASK_PRIORITY, &opus_encode_task_handle_, OPUS_ENCODE_TASK_CORE);
+#else
     /* Start the opus codec task */
     xTaskCreate([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusCodecTask(true, true);
         vTaskDelete(NULL);
     }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+#endif
 }
 
 void AudioService::Stop() {
@@ -124,46 +215,59 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    sound_queue_.Clear();
+    mixer_sound_queue_.Clear();
+    sound_playback_queue_.Clear();
+    {
+        std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+        jitter_buffer_.Reset();
+    }
+    WakeAudioTasks();
+}
+
+void AudioService::WakeAudioTasks() {
+    if (audio_output_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_output_task_handle_);
+    }
+    if (opus_codec_task_handle_ != nullptr) {
+        xTaskNotifyGive(opus_codec_task_handle_);
+    }
+    if (opus_encode_task_handle_ != nullptr) {
+        xTaskNotifyGive(opus_encode_task_handle_);
+    }
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
     if (!codec_->input_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+        OnCodecPowerUp();
         codec_->EnableInput(true);
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        /* Read into the scratch buffer and resample straight into `data`, the buffers keep their capacity */
+        input_buffer_.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+        if (!codec_->InputData(input_buffer_)) {
             return false;
         }
         if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+            size_t frames = input_buffer_.size() / 2;
+            mic_buffer_.resize(frames);
+            reference_buffer_.resize(frames);
+            DeinterleaveStereo(input_buffer_.data(), mic_buffer_.data(), reference_buffer_.data(), frames);
+            resampled_mic_buffer_.resize(input_resampler_.GetOutputSamples(frames));
+            resampled_reference_buffer_.resize(reference_resampler_.GetOutputSamples(frames));
+            input_resampler_.Process(mic_buffer_.data(), frames, resampled_mic_buffer_.data());
+            reference_resampler_.Process(reference_buffer_.data(), frames, resampled_reference_buffer_.data());
+            size_t resampled_frames = std::min(resampled_mic_buffer_.size(), resampled_reference_buffer_.size());
+            data.resize(resampled_frames * 2);
+            InterleaveStereo(resampled_mic_buffer_.data(), resampled_reference_buffer_.data(), data.data(), resampled_frames);
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(input_buffer_.size()));
+            input_resampler_.Process(input_buffer_.data(), input_buffer_.size(), data.data());
         }
     } else {
         data.resize(samples * codec_->input_channels());
@@ -172,8 +276,23 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
         }
     }
 
+#if CONFIG_USE_AEC_DELAY_ESTIMATION
+    /* Line the reference up with the echo before the AFE sees it */
+    if (codec_->input_reference()) {
+        reference_aligner_.Process(data.data(), data.size() / codec_->input_channels(), codec_->input_channels());
+    }
+#endif
+
+#if CONFIG_USE_MIC_BEAMFORMER
+    /* Two microphones become one beam, in their slots, before the wake word and the audio processor */
+    if (codec_->input_channels() - codec_->input_reference() >= 2) {
+        mic_beamformer_.Process(data.data(), data.size() / codec_->input_channels(), codec_->input_channels());
+    }
+#endif
+
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
+    last_capture_time_us_ = esp_timer_get_time();
     debug_statistics_.input_count++;
 
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -188,6 +307,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* Reused across frames, consumers only read it or copy it */
+    std::vector<int16_t> data;
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -204,21 +325,17 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.Size() >= std::min(audio_testing_queue_.capacity(), FramesIn(AUDIO_TESTING_MAX_DURATION_MS, frame_duration_ms_))) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ms_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    DownmixStereoToLeft(data.data(), data.data(), data.size() / 2);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -227,11 +344,11 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
                     wake_word_->Feed(data);
+                    preroll_buffer_.Write(data.data(), data.size());
                     continue;
                 }
             }
@@ -239,10 +356,17 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    if (preroll_pending_.exchange(false)) {
+                        StartPrerollReplay(samples * codec_->input_channels());
+                    }
+                    if (preroll_replaying_) {
+                        FeedPrerollToProcessor(data, samples);
+                        continue;
+                    }
+                    processor_input_samples_ += samples;
                     audio_processor_->Feed(std::move(data));
                     continue;
                 }
@@ -256,184 +380,725 @@ void AudioService::AudioInputTask() {
     ESP_LOGW(TAG, "Audio input task stopped");
 }
 
+void AudioService::StartPrerollReplay(size_t chunk_samples) {
+    /* Start at the end of the wake word, rounded to whole feed chunks */
+    uint32_t written = preroll_buffer_.written();
+    size_t backlog = written - preroll_mark_.load();
+    backlog = (backlog + chunk_samples - 1) / chunk_samples * chunk_samples;
+    backlog = std::min(backlog, preroll_buffer_.stored() / chunk_samples * chunk_samples);
+    if (backlog == 0) {
+        return;
+    }
+    preroll_position_ = written - backlog;
+    preroll_replaying_ = true;
+    ESP_LOGI(TAG, "Replay %u ms of audio captured after the wake word",
+        (unsigned)(backlog / codec_->input_channels() * 1000 / 16000));
+}
+
+void AudioService::FeedPrerollToProcessor(std::vector<int16_t>& data, int samples) {
+    /* Live audio is queued behind the backlog, which is fed at twice real time until it is drained */
+    size_t chunk_samples = data.size();
+    preroll_buffer_.Write(data.data(), chunk_samples);
+    for (int i = 0; i < 2 && preroll_replaying_; i++) {
+        data.resize(chunk_samples);
+        if (!preroll_buffer_.Read(preroll_position_, data.data(), chunk_samples)) {
+            preroll_replaying_ = false;
+            break;
+        }
+        preroll_position_ += chunk_samples;
+        preroll_replaying_ = preroll_position_ != preroll_buffer_.written();
+        processor_input_samples_ += samples;
+        audio_processor_->Feed(std::move(data));
+    }
+}
+
 void AudioService::AudioOutputTask() {
+    audio_playback_queue_.SetNotifyOnPush(xTaskGetCurrentTaskHandle());
+    mixer_sound_queue_.SetNotifyOnPush(xTaskGetCurrentTaskHandle());
+    sound_playback_queue_.SetNotifyOnPush(xTaskGetCurrentTaskHandle());
+    mixer_.Reset();
+
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        AudioTaskPtr task;
+        while (!service_stopped_ && !audio_playback_queue_.Pop(task) && !HasSoundToMix()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
         if (service_stopped_) {
             break;
         }
-
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        if (task) {
+            UpdateOutputStream(*task);
+        } else {
+            /* Only a sound is playing, mix it over silence */
+            task = AudioTaskPool::GetInstance().Acquire();
+            task->pcm.assign(codec_->output_sample_rate() * OPUS_FRAME_DURATION_MS / 1000, 0);
+        }
+        MixSounds(task->pcm);
 
         if (!codec_->output_enabled()) {
-            esp_timer_stop(audio_power_timer_);
-            esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+            OnCodecPowerUp();
             codec_->EnableOutput(true);
         }
         codec_->OutputData(task->pcm);
+        /* The write returns once the data is queued, the DMA runs dry at most one DMA depth later */
+        int64_t written_us = esp_timer_get_time();
+        int64_t duration_us = int64_t(task->pcm.size()) * 1000000 / codec_->output_sample_rate();
+        output_dry_time_us_ = std::min(written_us + output_dma_latency_us_, std::max(output_dry_time_us_, written_us) + duration_us);
+        output_dry_buffers_mark_ = codec_->output_buffers_dry();
+#if CONFIG_USE_SERVER_AEC
+        playback_clock_.OnWritten(task->timestamp, task->pcm.size(), esp_timer_get_time());
+#endif
+        if (task->time_us > 0) {
+            RecordLatency(kAudioLatencyPlayback, task->time_us);
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
+    }
 
-#if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+    /* Release the slots that were cleared by Stop(), the opus codec task may be waiting for them */
+    audio_playback_queue_.DiscardCleared();
+    audio_playback_queue_.SetNotifyOnPush(nullptr);
+    mixer_sound_queue_.DiscardCleared();
+    mixer_sound_queue_.SetNotifyOnPush(nullptr);
+    sound_playback_queue_.DiscardCleared();
+    sound_playback_queue_.SetNotifyOnPush(nullptr);
+    mixing_sound_ = nullptr;
+    mixing_packet_.reset();
+    audio_output_task_handle_ = nullptr;
+    ESP_LOGW(TAG, "Audio output task stopped");
+}
+
+void AudioService::OpusCodecTask(bool decode, bool encode) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (decode) {
+        audio_decode_queue_.SetNotifyOnPush(self);
+        sound_queue_.SetNotifyOnPush(self);
+        mixer_sound_queue_.SetNotifyOnPop(self);
+        sound_playback_queue_.SetNotifyOnPop(self);
+        audio_playback_queue_.SetNotifyOnPop(self);
+    }
+    if (encode) {
+        audio_encode_queue_.SetNotifyOnPush(self);
+        audio_send_queue_.SetNotifyOnPop(self);
+    }
+
+    while (!service_stopped_) {
+        bool can_decode = false;
+        bool can_encode = false;
+        TickType_t wait_ticks = portMAX_DELAY;
+        /* Sounds skip the playback queue, they are prepared even while it is full */
+        if (decode && PrepareNextSound()) {
+            continue;
+        }
+        if (decode && audio_playback_queue_.Size() < FramesIn(MAX_PLAYBACK_QUEUE_DURATION_MS, opus_decoder_->duration_ms())) {
+            audio_decode_queue_.DiscardCleared();
+            can_decode = !audio_decode_queue_.Empty();
+            if (!can_decode) {
+                std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+                int64_t now_ms = esp_timer_get_time() / 1000;
+                can_decode = jitter_buffer_.IsReady(now_ms, audio_playback_queue_.Empty());
+                // Still prefilling, wake up when the prefill deadline expires
+                int wait_ms = jitter_buffer_.GetWaitTime(now_ms);
+                if (!can_decode && wait_ms >= 0) {
+                    wait_ticks = pdMS_TO_TICKS(wait_ms) + 1;
+                }
+            }
+        }
+        if (encode) {
+            audio_encode_queue_.DiscardCleared();
+            can_encode = !audio_encode_queue_.Empty() && audio_send_queue_.Size() < FramesIn(MAX_SEND_QUEUE_DURATION_MS, frame_duration_ms_);
+        }
+        if (!can_decode && !can_encode) {
+            ulTaskNotifyTake(pdTRUE, wait_ticks);
+            continue;
+        }
+
+        if (can_decode) {
+            DecodeNextPacket();
+        }
+        if (can_encode) {
+            EncodeNextTask();
         }
-#endif
     }
 
-    ESP_LOGW(TAG, "Audio output task stopped");
+    /* Release the slots that were cleared by Stop(), producers may be waiting for them */
+    if (decode) {
+        audio_decode_queue_.DiscardCleared();
+        audio_decode_queue_.SetNotifyOnPush(nullptr);
+        sound_queue_.DiscardCleared();
+        sound_queue_.SetNotifyOnPush(nullptr);
+        mixer_sound_queue_.SetNotifyOnPop(nullptr);
+        sound_playback_queue_.SetNotifyOnPop(nullptr);
+        sound_streaming_ = false;
+        sound_decoder_.reset();
+        audio_playback_queue_.SetNotifyOnPop(nullptr);
+        opus_codec_task_handle_ = nullptr;
+    }
+    if (encode) {
+        audio_encode_queue_.DiscardCleared();
+        audio_encode_queue_.SetNotifyOnPush(nullptr);
+        audio_send_queue_.SetNotifyOnPop(nullptr);
+        if (!decode) {
+            opus_encode_task_handle_ = nullptr;
+        }
+    }
+    ESP_LOGW(TAG, "Opus %s task stopped", decode && encode ? "codec" : (decode ? "decode" : "encode"));
 }
 
-void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
+void AudioService::DecodeNextPacket() {
+    AudioStreamPacketPtr packet;
+    bool lost = false;
+    if (!audio_decode_queue_.Pop(packet)) {
+        std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+        auto result = jitter_buffer_.Pop(packet, esp_timer_get_time() / 1000, audio_playback_queue_.Empty());
+        if (result == AudioJitterBuffer::kPopNone) {
+            return;
         }
+        lost = result == AudioJitterBuffer::kPopLost;
+    }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+    /* Requested by ResetDecoder() before it cleared the queues, so a packet of the new stream always sees it */
+    if (decoder_reset_requested_.exchange(false, std::memory_order_acq_rel)) {
+        decoder_pool_->ResetState();
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    auto task = AudioTaskPool::GetInstance().Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+    // An empty payload makes the decoder conceal one lost frame at its current rate and duration
+    std::vector<uint8_t>* payload = &empty_payload_;
+    if (!lost) {
+        if (packet->time_us > 0) {
+            RecordLatency(kAudioLatencyDecode, packet->time_us);
+        }
+        task->timestamp = packet->timestamp;
+        SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+        payload = &packet->payload;
+    }
+    // Decode straight into the pooled buffer, or into the scratch buffer if it has to be resampled
+    bool resample = output_resampler_ != nullptr;
+    auto& decoded = resample ? decode_buffer_ : task->pcm;
+    // The decoder only reads the payload, the packet keeps its buffer for when the pool hands it out again
+    if (!opus_decoder_->Decode(std::move(*payload), decoded)) {
+        ESP_LOGE(TAG, "Failed to decode audio");
+        debug_statistics_.decode_count++;
+        return;
+    }
+    // Resample if the sample rate is different
+    if (resample) {
+        task->pcm.resize(output_resampler_->GetOutputSamples(decoded.size()));
+        output_resampler_->Process(decoded.data(), decoded.size(), task->pcm.data());
+    }
+    UpdateWorkerStatistics(debug_statistics_.decode_time_us, debug_statistics_.decode_max_time_us, start_time);
+    debug_statistics_.decode_count++;
+    task->time_us = esp_timer_get_time();
+    PushTaskToPlaybackQueue(std::move(task));
+}
+
+void AudioService::PushTaskToPlaybackQueue(AudioTaskPtr task) {
+    /* Slots released by ResetDecoder() are freed lazily by the output task */
+    while (!audio_playback_queue_.Push(std::move(task)) && !service_stopped_) {
+        int frame_duration = opus_decoder_->duration_ms();
+        audio_playback_queue_.WaitForSpace(FramesIn(MAX_PLAYBACK_QUEUE_DURATION_MS, frame_duration), pdMS_TO_TICKS(frame_duration));
+    }
+}
+
+bool AudioService::PrepareNextSound() {
+    if (sound_streaming_) {
+        return DecodeSoundPacket();
+    }
+    /* Sounds are taken in order, once the mixer queue has room for the next one */
+    std::string_view ogg;
+    if (mixer_sound_queue_.Full() || !sound_queue_.Pop(ogg)) {
+        return false;
+    }
+#if CONFIG_USE_SOUND_PCM_CACHE
+    CachedSound* sound = FindCachedSound(ogg);
+    if (sound != nullptr && (sound->state == kCachedSoundReady || FillSoundCache(*sound))) {
+        mixer_sound_queue_.Push(std::move(sound));
+        return true;
+    }
+#endif
+    /* Not cached, decode it as it plays */
+    StartSoundStream(ogg);
+    return true;
+}
+
+void AudioService::StartSoundStream(const std::string_view& ogg) {
+    sound_stream_ = ogg;
+    sound_stream_position_ = 0;
+    sound_streaming_ = true;
+    sound_demuxer_.Reset();
+    if (sound_decoder_) {
+        sound_decoder_->ResetState();
+        sound_resampler_.Reset();
+    }
+    /* The mixer takes the sound once its first packet is decoded, so it does not start with a gap */
+    DecodeSoundPacket();
+    CachedSound* sound = &streamed_sound_;
+    mixer_sound_queue_.Push(std::move(sound));
+}
+
+bool AudioService::DecodeSoundPacket() {
+    if (sound_playback_queue_.Size() >= FramesIn(MAX_SOUND_PLAYBACK_QUEUE_DURATION_MS, sound_frame_duration_)) {
+        return false;
+    }
+    /* One byte at a time, so the demuxer stops right after the next packet */
+    auto data = reinterpret_cast<const uint8_t*>(sound_stream_.data());
+    sound_packet_.clear();
+    while (sound_packet_.empty() && sound_stream_position_ < sound_stream_.size()) {
+        sound_demuxer_.Process(data + sound_stream_position_++, 1);
+    }
+
+    auto task = AudioTaskPool::GetInstance().Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    if (sound_packet_.empty()) {
+        /* The empty task ends the sound, the decoder is kept for the next one */
+        sound_streaming_ = false;
+        if (sound_queue_.Empty()) {
+            sound_decoder_.reset();
+        }
+    } else {
+        int64_t start_time = esp_timer_get_time();
+        int sample_rate = sound_demuxer_.sample_rate();
+        if (!sound_decoder_ || sound_decoder_->sample_rate() != sample_rate) {
+            /* Sized for the longest packet, the sound's packets may use any duration */
+            sound_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, MAX_OPUS_FRAME_DURATION_MS);
+            if (sample_rate != codec_->output_sample_rate()) {
+                sound_resampler_.Configure(sample_rate, codec_->output_sample_rate());
             }
-            debug_statistics_.decode_count++;
-        }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
+        }
+        bool resample = sample_rate != codec_->output_sample_rate();
+        auto& decoded = resample ? decode_buffer_ : task->pcm;
+        if (!sound_decoder_->Decode(std::move(sound_packet_), decoded) || decoded.empty()) {
+            ESP_LOGE(TAG, "Failed to decode sound");
+            return true;
+        }
+        if (resample) {
+            task->pcm.resize(sound_resampler_.GetOutputSamples(decoded.size()));
+            sound_resampler_.Process(decoded.data(), decoded.size(), task->pcm.data());
+        }
+        UpdateWorkerStatistics(debug_statistics_.decode_time_us, debug_statistics_.decode_max_time_us, start_time);
+        debug_statistics_.decode_count++;
+    }
+    sound_playback_queue_.Push(std::move(task));
+    return true;
+}
+
+bool AudioService::HasSoundToMix() {
+    if (mixing_sound_ == nullptr) {
+        CachedSound* sound = nullptr;
+        if (!mixer_sound_queue_.Pop(sound)) {
+            return false;
+        }
+        mixing_sound_ = sound;
+        mixing_sound_position_ = 0;
+    }
+    return true;
+}
+
+void AudioService::UpdateOutputStream(const AudioTask& task) {
+    auto& stats = debug_statistics_;
+    int64_t now = esp_timer_get_time();
+    uint32_t dry_buffers = codec_->output_buffers_dry() - output_dry_buffers_mark_;
+    if (output_dry_time_us_ == 0 || now > output_dry_time_us_ + OUTPUT_STREAM_GAP_MS * 1000) {
+        /* A new stream, shrink the prefill if the last one played without underruns */
+        if (output_dry_time_us_ != 0 && !output_stream_underrun_ && stats.output_prefill_ms > 0) {
+            stats.output_prefill_ms -= std::min<uint32_t>(stats.output_prefill_ms, OUTPUT_PREFILL_STEP_MS);
+        }
+        output_stream_underrun_ = false;
+        stats.output_streams++;
+
+        /* Hold the first frame until the prefill is queued, or the prefill time has passed */
+        int frame_ms = task.pcm.size() * 1000 / codec_->output_sample_rate();
+        int64_t deadline = now + stats.output_prefill_ms * 1000;
+        while (!service_stopped_ && frame_ms > 0 && (audio_playback_queue_.Size() + 1) * frame_ms < stats.output_prefill_ms) {
+            int64_t remaining_us = deadline - esp_timer_get_time();
+            if (remaining_us <= 0) {
+                break;
             }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining_us / 1000) + 1);
+        }
+    } else if (now > output_dry_time_us_ || dry_buffers > 0) {
+        /* The stream went on after the DMA ran out of data */
+        stats.output_underruns++;
+        stats.output_dry_buffers += dry_buffers;
+        output_stream_underrun_ = true;
+        stats.output_prefill_ms = std::min<uint32_t>(stats.output_prefill_ms + OUTPUT_PREFILL_STEP_MS, OUTPUT_PREFILL_MAX_MS);
+    }
+}
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
+void AudioService::MixSounds(std::vector<int16_t>& pcm) {
+    /* Sound PCM is already at the output rate, queued sounds play one after another */
+    mixer_.ApplyStreamGain(pcm.data(), pcm.size(), HasSoundToMix());
+    size_t offset = 0;
+    while (offset < pcm.size() && HasSoundToMix()) {
+        const int16_t* samples = mixing_sound_->pcm;
+        size_t length = mixing_sound_->samples;
+        if (mixing_sound_ == &streamed_sound_) {
+            if (!mixing_packet_ || mixing_sound_position_ >= mixing_packet_->pcm.size()) {
+                if (!sound_playback_queue_.Pop(mixing_packet_)) {
+                    /* The decoder is behind, the rest of the frame plays without the sound */
+                    debug_statistics_.sound_underruns++;
+                    break;
                 }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
+                mixing_sound_position_ = 0;
+                if (mixing_packet_->pcm.empty()) {
+                    mixing_packet_.reset();
+                    mixing_sound_ = nullptr;
+                    continue;
                 }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
+            samples = mixing_packet_->pcm.data();
+            length = mixing_packet_->pcm.size();
+        }
+        size_t count = std::min(pcm.size() - offset, length - mixing_sound_position_);
+        AudioMixer::Mix(pcm.data() + offset, samples + mixing_sound_position_, count, AUDIO_MIXER_UNITY_GAIN);
+        offset += count;
+        mixing_sound_position_ += count;
+        if (mixing_sound_ != &streamed_sound_ && mixing_sound_position_ >= length) {
+            mixing_sound_ = nullptr;
         }
     }
+}
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+#if CONFIG_USE_SOUND_PCM_CACHE
+bool AudioService::FillSoundCache(CachedSound& sound) {
+    std::unique_ptr<OpusDecoderWrapper> decoder;
+    PcmResampler resampler;
+    std::vector<int16_t> decoded;
+    std::vector<int16_t> resampled;
+    std::vector<uint8_t> opus;
+    size_t capacity = 0;
+    bool failed = false;
+
+    ForEachOggPacket(sound.ogg, [&](int sample_rate, int frame_duration, const uint8_t* data, size_t size) {
+        if (failed) {
+            return;
+        }
+        if (!decoder) {
+            /* Sized for the longest packet, the sound's packets may use any duration */
+            decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, MAX_OPUS_FRAME_DURATION_MS);
+            if (sample_rate != codec_->output_sample_rate()) {
+                resampler.Configure(sample_rate, codec_->output_sample_rate());
+            }
+        }
+        opus.assign(data, data + size);
+        if (!decoder->Decode(std::move(opus), decoded)) {
+            return;
+        }
+        auto* pcm = &decoded;
+        if (decoder->sample_rate() != codec_->output_sample_rate()) {
+            resampled.resize(resampler.GetOutputSamples(decoded.size()));
+            resampler.Process(decoded.data(), decoded.size(), resampled.data());
+            pcm = &resampled;
+        }
+
+        size_t samples = sound.samples + pcm->size();
+        if (sound_cache_bytes_ + samples * sizeof(int16_t) > SOUND_PCM_CACHE_MAX_BYTES) {
+            failed = true;
+            return;
+        }
+        if (samples > capacity) {
+            capacity = std::max(samples, capacity * 2);
+            auto* buffer = (int16_t*)heap_caps_realloc(sound.pcm, capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+            if (buffer == nullptr) {
+                failed = true;
+                return;
+            }
+            sound.pcm = buffer;
+        }
+        std::memcpy(sound.pcm + sound.samples, pcm->data(), pcm->size() * sizeof(int16_t));
+        sound.samples = samples;
+    });
+
+    if (failed || sound.samples == 0) {
+        ESP_LOGW(TAG, "Failed to cache sound (%u bytes of PCM)", sound.samples * sizeof(int16_t));
+        heap_caps_free(sound.pcm);
+        sound.pcm = nullptr;
+        sound.samples = 0;
+        sound.state = kCachedSoundFailed;
+        return false;
+    }
+
+    /* Give back the unused tail of the buffer */
+    auto* buffer = (int16_t*)heap_caps_realloc(sound.pcm, sound.samples * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (buffer != nullptr) {
+        sound.pcm = buffer;
+    }
+    sound_cache_bytes_ += sound.samples * sizeof(int16_t);
+    sound.state = kCachedSoundReady;
+    ESP_LOGI(TAG, "Cached sound: %u samples, cache size %u bytes", sound.samples, sound_cache_bytes_);
+    return true;
+}
+#endif
+
+void AudioService::EncodeNextTask() {
+    AudioTaskPtr task;
+    if (!audio_encode_queue_.Pop(task)) {
+        return;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    // The frame size follows the session frame duration at the time the audio was captured
+    int frame_duration = task->pcm.size() * 1000 / 16000;
+    if (opus_encoder_->duration_ms() != frame_duration) {
+        ESP_LOGI(TAG, "Opus encoder frame duration changed to %d ms", frame_duration);
+        opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+        ApplyEncoderSettings();
+    }
+    auto packet = AudioStreamPacketPool::GetInstance().Acquire();
+    packet->frame_duration = frame_duration;
+    packet->sample_rate = 16000;
+    packet->timestamp = task->timestamp;
+    if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
+        ESP_LOGE(TAG, "Failed to encode audio");
+        return;
+    }
+    UpdateWorkerStatistics(debug_statistics_.encode_time_us, debug_statistics_.encode_max_time_us, start_time);
+#if CONFIG_USE_ADAPTIVE_OPUS_ENCODER
+    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+        int send_queue_ms = audio_send_queue_.Size() * frame_duration;
+        if (encoder_controller_.OnFrameEncoded(frame_duration, esp_timer_get_time() - start_time, send_queue_ms, voice_detected_)) {
+            ApplyEncoderSettings();
+        }
+    }
+#endif
+
+    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
+        RecordLatency(kAudioLatencyEncode, task->time_us);
+        packet->time_us = esp_timer_get_time();
+        /* The encoder only runs with room in the send queue, a full one means it was not emptied in time */
+        if (!audio_send_queue_.Push(std::move(packet))) {
+            debug_statistics_.send_packets_dropped++;
+            ESP_LOGW(TAG, "Send queue is full, dropped an encoded packet (%lu dropped)", debug_statistics_.send_packets_dropped);
+        }
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
+        if (!audio_testing_queue_.Push(std::move(packet))) {
+            ESP_LOGW(TAG, "Audio testing queue is full, dropped an encoded packet");
+        }
+    }
+    debug_statistics_.encode_count++;
+}
+
+void AudioService::ApplyEncoderSettings() {
+    /* Without CONFIG_USE_ADAPTIVE_OPUS_ENCODER the controller keeps its defaults: complexity 0, no DTX */
+    auto& settings = encoder_controller_.settings();
+    opus_encoder_->SetComplexity(settings.complexity);
+    opus_encoder_->SetDtx(settings.dtx);
+}
+
+void AudioService::UpdateWorkerStatistics(uint64_t& total_us, uint32_t& max_us, int64_t start_time) {
+    uint32_t elapsed = esp_timer_get_time() - start_time;
+    total_us += elapsed;
+    if (elapsed > max_us) {
+        max_us = elapsed;
+    }
+}
+
+size_t AudioService::FramesIn(int duration_ms, int frame_duration_ms) {
+    // Keep at least double buffering when the frames are long
+    return std::max(2, duration_ms / frame_duration_ms);
+}
+
+void AudioService::RecordLatency(AudioLatencyStage stage, int64_t start_time_us) {
+    debug_statistics_.latency[stage].Record(esp_timer_get_time() - start_time_us);
+}
+
+cJSON* AudioService::GetLatencyStatisticsJson() {
+    static const int bounds_ms[] = AUDIO_LATENCY_BUCKET_BOUNDS_MS;
+    cJSON* root = cJSON_CreateObject();
+    cJSON* bounds = cJSON_CreateArray();
+    for (int bound : bounds_ms) {
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(bound));
+    }
+    cJSON_AddItemToObject(root, "bucket_bounds_ms", bounds);
+    for (int i = 0; i < kAudioLatencyStageCount; i++) {
+        auto& histogram = debug_statistics_.latency[i];
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", histogram.count);
+        cJSON_AddNumberToObject(stage, "avg_ms", histogram.average_us() / 1000.0);
+        cJSON_AddNumberToObject(stage, "max_ms", histogram.max_us / 1000.0);
+        cJSON* buckets = cJSON_CreateArray();
+        for (uint32_t count : histogram.buckets) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(count));
+        }
+        cJSON_AddItemToObject(stage, "buckets", buckets);
+        cJSON_AddItemToObject(root, AudioLatencyStageName(i), stage);
+    }
+    cJSON* output = cJSON_CreateObject();
+    cJSON_AddNumberToObject(output, "streams", debug_statistics_.output_streams);
+    cJSON_AddNumberToObject(output, "underruns", debug_statistics_.output_underruns);
+    cJSON_AddNumberToObject(output, "dry_dma_buffers", debug_statistics_.output_dry_buffers);
+    cJSON_AddNumberToObject(output, "prefill_ms", debug_statistics_.output_prefill_ms);
+    cJSON_AddNumberToObject(output, "dma_depth_ms", output_dma_latency_us_ / 1000);
+    cJSON_AddItemToObject(root, "output", output);
+#if CONFIG_USE_AEC_DELAY_ESTIMATION
+    if (reference_aligner_.delay_us() != INT32_MIN) {
+        cJSON* aec = cJSON_CreateObject();
+        cJSON_AddNumberToObject(aec, "reference_delay_ms", reference_aligner_.delay_us() / 1000.0);
+        cJSON_AddNumberToObject(aec, "shift_samples", reference_aligner_.shift_samples());
+        cJSON_AddItemToObject(root, "aec", aec);
+    }
+#endif
+    return root;
+}
+
+void AudioService::PrintDebugStatistics() {
+    auto& stats = debug_statistics_;
+    ESP_LOGI(TAG, "Audio stats: input %lu, decode %lu (avg %lu us, max %lu us), encode %lu (avg %lu us, max %lu us, %lu dropped), playback %lu",
+        stats.input_count,
+        stats.decode_count, (uint32_t)(stats.decode_count ? stats.decode_time_us / stats.decode_count : 0), stats.decode_max_time_us,
+        stats.encode_count, (uint32_t)(stats.encode_count ? stats.encode_time_us / stats.encode_count : 0), stats.encode_max_time_us,
+        stats.send_packets_dropped, stats.playback_count);
+
+    ESP_LOGI(TAG, "Audio output: streams %lu, underruns %lu, dry DMA buffers %lu, prefill %lu ms, DMA depth %lu ms, sound underruns %lu",
+        stats.output_streams, stats.output_underruns, stats.output_dry_buffers, stats.output_prefill_ms,
+        (uint32_t)(output_dma_latency_us_ / 1000), stats.sound_underruns);
+
+#if CONFIG_USE_AEC_DELAY_ESTIMATION
+    if (reference_aligner_.delay_us() != INT32_MIN) {
+        ESP_LOGI(TAG, "AEC reference: leads the echo by %ld us, shifted by %d samples",
+            (long)reference_aligner_.delay_us(), reference_aligner_.shift_samples());
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+    auto& jitter = jitter_buffer_.statistics();
+    ESP_LOGI(TAG, "Jitter buffer: depth %u/%d, jitter %d ms, received %lu, reordered %lu, late %lu, duplicated %lu, concealed %lu, skipped %lu, rebuffers %lu",
+        jitter_buffer_.size(), jitter_buffer_.target_depth(), jitter_buffer_.jitter_ms(),
+        jitter.received, jitter.reordered, jitter.late, jitter.duplicated, jitter.concealed, jitter.skipped, jitter.rebuffers);
+
+    for (int i = 0; i < kAudioLatencyStageCount; i++) {
+        auto& histogram = stats.latency[i];
+        if (histogram.count == 0) {
+            continue;
+        }
+        auto& b = histogram.buckets;
+        ESP_LOGI(TAG, "Latency %s: count %lu, avg %lu us, max %lu us, buckets <5/10/20/40/80/160/320/more ms: %lu/%lu/%lu/%lu/%lu/%lu/%lu/%lu",
+            AudioLatencyStageName(i), histogram.count, histogram.average_us(), histogram.max_us,
+            b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7]);
+    }
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+    if (opus_decoder_ != nullptr && opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    /* Switching streams picks a ready decoder, its state is kept for when the stream comes back */
+    auto& entry = decoder_pool_->Get(sample_rate, frame_duration);
+    opus_decoder_ = entry.decoder.get();
+    output_resampler_ = entry.resampler.get();
+}
+
+void AudioService::SetFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 10 && frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms, keeping %d ms", frame_duration_ms, frame_duration_ms_);
+        return;
+    }
+    if (frame_duration_ms != frame_duration_ms_) {
+        ESP_LOGI(TAG, "Session frame duration: %d ms", frame_duration_ms);
+        frame_duration_ms_ = frame_duration_ms;
+    }
+}
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+int AudioService::GetPreferredFrameDuration() {
+#if CONFIG_USE_ADAPTIVE_OPUS_FRAME_DURATION
+    std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+    auto& stats = jitter_buffer_.statistics();
+    uint32_t received = stats.received - adaptive_received_packets_;
+    uint32_t lost = stats.concealed + stats.skipped - adaptive_lost_packets_;
+    if (received < ADAPTIVE_FRAME_DURATION_MIN_PACKETS) {
+        return preferred_frame_duration_ms_;
     }
+    adaptive_received_packets_ = stats.received;
+    adaptive_lost_packets_ = stats.concealed + stats.skipped;
+
+    /* Longer frames on a jittery or lossy link, back to the configured duration on a good one */
+    static const int durations[] = {10, 20, 40, 60};
+    int index = std::find(std::begin(durations), std::end(durations), preferred_frame_duration_ms_) - std::begin(durations);
+    int jitter_ms = jitter_buffer_.jitter_ms();
+    if ((jitter_ms > preferred_frame_duration_ms_ || lost * 20 > received) && preferred_frame_duration_ms_ < MAX_OPUS_FRAME_DURATION_MS) {
+        preferred_frame_duration_ms_ = durations[index + 1];
+    } else if (jitter_ms < preferred_frame_duration_ms_ / 2 && lost * 100 < received && preferred_frame_duration_ms_ > OPUS_FRAME_DURATION_MS) {
+        preferred_frame_duration_ms_ = durations[index - 1];
+    }
+    ESP_LOGI(TAG, "Link jitter %d ms, lost %lu/%lu, preferred frame duration %d ms",
+        jitter_ms, lost, received, preferred_frame_duration_ms_);
+#endif
+    return preferred_frame_duration_ms_;
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp) {
+    auto task = AudioTaskPool::GetInstance().Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-
-    /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    // Copy into the pooled buffer so it keeps its capacity across frames
+    task->pcm.assign(pcm.begin(), pcm.end());
+    task->time_us = esp_timer_get_time();
+    task->timestamp = timestamp;
+
+    /* Push the task to the encode queue, producers only contend with each other */
+    size_t max_tasks = FramesIn(MAX_ENCODE_QUEUE_DURATION_MS, frame_duration_ms_);
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(encode_producer_mutex_);
+            if (audio_encode_queue_.Size() < max_tasks && audio_encode_queue_.Push(std::move(task))) {
+                return;
+            }
         }
-        timestamp_queue_.pop_front();
+        audio_encode_queue_.WaitForSpace(max_tasks, pdMS_TO_TICKS(frame_duration_ms_));
     }
-
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    if (packet->sequence != 0) {
+        bool accepted;
+        {
+            std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+            accepted = jitter_buffer_.Push(std::move(packet), esp_timer_get_time() / 1000);
+        }
+        TaskHandle_t decode_task = opus_codec_task_handle_;
+        if (accepted && decode_task != nullptr) {
+            xTaskNotifyGive(decode_task);
+        }
+        return accepted;
+    }
+
+    int frame_duration = packet->frame_duration > 0 ? packet->frame_duration : OPUS_FRAME_DURATION_MS;
+    size_t max_packets = FramesIn(MAX_DECODE_QUEUE_DURATION_MS, frame_duration);
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+            if (audio_decode_queue_.Size() < max_packets && audio_decode_queue_.Push(std::move(packet))) {
+                return true;
+            }
+        }
+        if (!wait) {
             return false;
         }
+        audio_decode_queue_.WaitForSpace(max_packets, pdMS_TO_TICKS(frame_duration));
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (!audio_send_queue_.Pop(packet)) {
         return nullptr;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
+void AudioService::ReportSendFailure() {
+    encoder_controller_.ReportSendFailure();
+}
+
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
         wake_word_->EncodeWakeWordData();
@@ -444,8 +1109,8 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+AudioStreamPacketPtr AudioService::PopWakeWordPacket() {
+    auto packet = AudioStreamPacketPool::GetInstance().Acquire();
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
         return packet;
     }
@@ -464,8 +1129,12 @@ void AudioService::EnableWakeWordDetection(bool enable) {
                 ESP_LOGE(TAG, "Failed to initialize wake word");
                 return;
             }
+            if (WAKE_WORD_PREROLL_MS > 0) {
+                preroll_buffer_.Allocate(16000 * WAKE_WORD_PREROLL_MS / 1000 * codec_->input_channels());
+            }
             wake_word_initialized_ = true;
         }
+        preroll_pending_ = false;
         wake_word_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     } else {
@@ -478,13 +1147,20 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
             audio_processor_initialized_ = true;
         }
+        audio_processor_->SetFrameDuration(frame_duration_ms_);
+        processor_input_samples_ = 0;
+        processor_output_samples_ = 0;
+        endpoint_detector_.Reset();
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        /* After a wake word the input never stopped, start from the audio kept since then.
+           An input that is running, or kept configured by a codec in standby, is settled already.
+           Only a cold one needs the warm-up, standby() is false on codecs without standby support */
+        audio_input_need_warmup_ = !preroll_pending_ && !codec_->input_enabled() && !codec_->standby();
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
@@ -499,17 +1175,22 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Move audio_testing_queue_ to audio_decode_queue_ */
+        std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+        audio_decode_queue_.Clear();
+        AudioStreamPacketPtr packet;
+        while (audio_testing_queue_.Pop(packet)) {
+            if (!audio_decode_queue_.Push(std::move(packet))) {
+                break;
+            }
+        }
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, frame_duration_ms_, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -522,133 +1203,110 @@ void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
 
 void AudioService::PlaySound(const std::string_view& ogg) {
     if (!codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+        OnCodecPowerUp();
         codec_->EnableOutput(true);
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
-
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
-        }
-        return static_cast<size_t>(-1);
-    };
-
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
-
+    /* Every sound is mixed over the stream, the decode task prepares them in order */
     while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
+        {
+            std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+            std::string_view sound = ogg;
+            if (sound_queue_.Push(std::move(sound))) {
+                return;
             }
-
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
         }
+        sound_queue_.WaitForSpace(MAX_SOUNDS_IN_QUEUE, pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS));
+    }
+}
 
-        offset = body_off + body_size;
+#if CONFIG_USE_SOUND_PCM_CACHE
+CachedSound* AudioService::FindCachedSound(const std::string_view& ogg) {
+    /* Sounds are embedded or mapped assets, their address identifies them */
+    auto it = std::find_if(sound_cache_.begin(), sound_cache_.end(), [&ogg](const std::unique_ptr<CachedSound>& sound) {
+        return sound->ogg.data() == ogg.data() && sound->ogg.size() == ogg.size();
+    });
+    if (it != sound_cache_.end()) {
+        return (*it)->state == kCachedSoundFailed ? nullptr : it->get();
+    }
+    if (sound_cache_bytes_ >= SOUND_PCM_CACHE_MAX_BYTES) {
+        return nullptr;
     }
+    sound_cache_.push_back(std::make_unique<CachedSound>());
+    sound_cache_.back()->ogg = ogg;
+    return sound_cache_.back().get();
 }
 
+void AudioService::ForEachOggPacket(const std::string_view& ogg, std::function<void(int sample_rate, int frame_duration, const uint8_t* data, size_t size)> callback) {
+    OggDemuxer demuxer;
+    demuxer.OnPacket([&demuxer, &callback](const uint8_t* data, size_t size) {
+        int frame_duration = OggDemuxer::GetOpusPacketDuration(data, size);
+        if (frame_duration == 0 || frame_duration > MAX_OPUS_FRAME_DURATION_MS) {
+            ESP_LOGW(TAG, "Skip Opus packet with unsupported duration: %d ms", frame_duration);
+            return;
+        }
+        callback(demuxer.sample_rate(), frame_duration, data, size);
+    });
+    demuxer.Process(reinterpret_cast<const uint8_t*>(ogg.data()), ogg.size());
+}
+#endif
+
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    if (!audio_encode_queue_.Empty() || !audio_decode_queue_.Empty() || !audio_playback_queue_.Empty() || !audio_testing_queue_.Empty()) {
+        return false;
+    }
+    if (!sound_queue_.Empty() || sound_streaming_ || !mixer_sound_queue_.Empty() || !sound_playback_queue_.Empty() || mixing_sound_ != nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+    return jitter_buffer_.size() == 0;
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    /* Only the stream is reset, sounds already handed to the mixer keep playing */
+    /* The decoders belong to the decode task, it resets them before decoding the next packet */
+    decoder_reset_requested_.store(true, std::memory_order_release);
+    playback_clock_.Reset();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    std::lock_guard<std::mutex> lock(jitter_buffer_mutex_);
+    jitter_buffer_.Reset();
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
     auto now = std::chrono::steady_clock::now();
     auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
     auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_output_time_).count();
+
+    /* Standby is decided first, the codec drivers keep what they disable open while it is set */
+    if (codec_->supports_standby()) {
+        auto idle_elapsed = std::min(input_elapsed, output_elapsed);
+        auto window_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - power_up_times_[power_up_index_]).count();
+        bool frequent = power_up_count_ >= AUDIO_STANDBY_MIN_POWER_UPS && window_elapsed < AUDIO_STANDBY_WINDOW_MS;
+        codec_->EnableStandby(frequent && idle_elapsed < AUDIO_STANDBY_TIMEOUT_MS);
+    }
+
     if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled()) {
         codec_->EnableInput(false);
     }
     if (output_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
         codec_->EnableOutput(false);
     }
-    if (!codec_->input_enabled() && !codec_->output_enabled()) {
+    /* Keep checking while in standby, it ends after AUDIO_STANDBY_TIMEOUT_MS */
+    if (!codec_->input_enabled() && !codec_->output_enabled() && !codec_->standby()) {
         esp_timer_stop(audio_power_timer_);
     }
 }
 
+void AudioService::OnCodecPowerUp() {
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    power_up_times_[power_up_index_] = std::chrono::steady_clock::now();
+    power_up_index_ = (power_up_index_ + 1) % AUDIO_STANDBY_MIN_POWER_UPS;
+    power_up_count_ = std::min(power_up_count_ + 1, AUDIO_STANDBY_MIN_POWER_UPS);
+}
+
 void AudioService::SetModelsList(srmodel_list_t* models_list) {
     models_list_ = models_list;
 
@@ -656,7 +1314,11 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
     if (esp_srmodel_filter(models_list_, ESP_MN_PREFIX, NULL) != nullptr) {
         wake_word_ = std::make_unique<CustomWakeWord>();
     } else if (esp_srmodel_filter(models_list_, ESP_WN_PREFIX, NULL) != nullptr) {
+#if CONFIG_USE_SHARED_AFE
+        wake_word_ = std::make_unique<AfeWakeWord>(afe_front_end_.get());
+#else
         wake_word_ = std::make_unique<AfeWakeWord>();
+#endif
     } else {
         wake_word_ = nullptr;
     }
@@ -670,6 +1332,12 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            if (preroll_buffer_.capacity() > 0) {
+                /* The detector may lag behind the input, the command starts where it stopped */
+                uint32_t unprocessed = wake_word_->GetUnprocessedSamples() * codec_->input_channels();
+                preroll_mark_ = preroll_buffer_.written() - unprocessed;
+                preroll_pending_ = true;
+            }
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
@@ -2,10 +2,10 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <string_view>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -15,36 +15,130 @@
 
 #include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "spsc_queue.h"
+#include "audio_object_pool.h"
+#include "audio_jitter_buffer.h"
+#include "audio_latency.h"
+#include "pcm_ring_buffer.h"
+#include "pcm_resampler.h"
+#include "audio_playback_clock.h"
+#include "audio_decoder_pool.h"
+#include "audio_mixer.h"
+#include "ogg_demuxer.h"
+#include "audio_encoder_controller.h"
+#include "audio_endpoint_detector.h"
+#include "aec_reference_aligner.h"
+#include "mic_beamformer.h"
+#if CONFIG_USE_SHARED_AFE
+#include "processors/afe_front_end.h"
+#endif
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue / Jitter Buffer} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
  * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * Every queue is a lock-free SPSC ring, the tasks wake each other with task notifications.
+ * Queues with more than one possible producer (encode, decode) serialize their producers
+ * with a dedicated mutex that is never taken by the consumer.
+ *
+ * Server packets that carry a transport sequence number go through the jitter buffer instead
+ * of the decode queue, so they are reordered and missing frames are concealed by the decoder.
  */
 
-#define OPUS_FRAME_DURATION_MS 60
-#define MAX_ENCODE_TASKS_IN_QUEUE 2
-#define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// Preferred uplink frame duration, the session uses the one negotiated in the hello exchange
+#define OPUS_FRAME_DURATION_MS CONFIG_OPUS_FRAME_DURATION_MS
+#define MIN_OPUS_FRAME_DURATION_MS 10
+#define MAX_OPUS_FRAME_DURATION_MS 60
+// Queue limits are durations, the number of frames follows the frame duration in use
+#define MAX_ENCODE_QUEUE_DURATION_MS 120
+#define MAX_PLAYBACK_QUEUE_DURATION_MS 120
+#define MAX_DECODE_QUEUE_DURATION_MS 2400
+#define MAX_SEND_QUEUE_DURATION_MS 2400
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
-#define MAX_TIMESTAMPS_IN_QUEUE 3
+// Queue capacities fit the shortest frames, except testing which only runs before a session
+#define MAX_ENCODE_TASKS_IN_QUEUE (MAX_ENCODE_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+#define MAX_PLAYBACK_TASKS_IN_QUEUE (MAX_PLAYBACK_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+#define MAX_DECODE_PACKETS_IN_QUEUE (MAX_DECODE_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+#define MAX_SEND_PACKETS_IN_QUEUE (MAX_SEND_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS)
+#define MAX_TESTING_PACKETS_IN_QUEUE (AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS)
+#define MAX_SOUNDS_IN_QUEUE 4
+// Decoded audio of an uncached sound kept ahead of the mixer, plus the empty task that ends it
+#define MAX_SOUND_PLAYBACK_QUEUE_DURATION_MS 240
+#define MAX_SOUND_PLAYBACK_TASKS_IN_QUEUE (MAX_SOUND_PLAYBACK_QUEUE_DURATION_MS / MIN_OPUS_FRAME_DURATION_MS + 1)
+// Stream level while a sound is mixed over it, and the ramp to get there
+#define ALERT_DUCKING_PERCENT 30
+#define ALERT_DUCKING_RAMP_MS 20
+// Stream configurations (sample rate, frame duration) that keep a decoder ready
+#define OPUS_DECODER_POOL_SIZE 3
+#ifdef CONFIG_SOUND_PCM_CACHE_MAX_KB
+#define SOUND_PCM_CACHE_MAX_BYTES (CONFIG_SOUND_PCM_CACHE_MAX_KB * 1024)
+#endif
+#ifdef CONFIG_WAKE_WORD_PREROLL_MS
+#define WAKE_WORD_PREROLL_MS CONFIG_WAKE_WORD_PREROLL_MS
+#else
+#define WAKE_WORD_PREROLL_MS 0
+#endif
+#define JITTER_BUFFER_MIN_DEPTH 1
+#define JITTER_BUFFER_MAX_DELAY_MS 600
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 3
+// The output prefill grows by a step after an underrun and shrinks by one after a clean stream,
+// up to what the playback queue can hold, the decoder stops filling it there
+#define OUTPUT_PREFILL_MAX_MS MAX_PLAYBACK_QUEUE_DURATION_MS
+#define OUTPUT_PREFILL_STEP_MS 20
+// A longer pause in the output starts a new stream instead of counting as an underrun
+#define OUTPUT_STREAM_GAP_MS 500
+// Used when CONFIG_USE_ADAPTIVE_OPUS_ENCODER is enabled
+#define ADAPTIVE_ENCODER_MAX_COMPLEXITY 5
+#define ADAPTIVE_ENCODER_WINDOW_MS 1000
+#define ADAPTIVE_ENCODER_CONGESTED_QUEUE_MS (MAX_SEND_QUEUE_DURATION_MS / 4)
+#ifdef CONFIG_USE_DEVICE_ENDPOINTING
+#define ENDPOINT_HANGOVER_MS CONFIG_ENDPOINT_HANGOVER_MS
+#define ENDPOINT_MIN_SPEECH_MS CONFIG_ENDPOINT_MIN_SPEECH_MS
+#define ENDPOINT_MIN_CONFIDENCE CONFIG_ENDPOINT_MIN_CONFIDENCE
+#else
+#define ENDPOINT_HANGOVER_MS 800
+#define ENDPOINT_MIN_SPEECH_MS 300
+#define ENDPOINT_MIN_CONFIDENCE 60
+#endif
+// Used when CONFIG_USE_AEC_DELAY_ESTIMATION is enabled, the reference is kept slightly ahead of the echo
+#define AEC_REFERENCE_MAX_DELAY_MS 32
+#define AEC_REFERENCE_LEAD_MS 2
+// Used when CONFIG_USE_MIC_BEAMFORMER is enabled: filter length, NLMS step (Q15), and the
+// beam to difference power ratio below which the filter stops adapting
+#define MIC_BEAMFORMER_TAPS 16
+#define MIC_BEAMFORMER_STEP 820
+#define MIC_BEAMFORMER_ADAPT_RATIO 8
+// Packets needed before CONFIG_USE_ADAPTIVE_OPUS_FRAME_DURATION judges the link
+#define ADAPTIVE_FRAME_DURATION_MIN_PACKETS 50
+// Objects in flight at the preferred frame duration, shorter frames may fall back to the heap
+#define MAX_AUDIO_PACKETS_IN_POOL ((MAX_DECODE_QUEUE_DURATION_MS + MAX_SEND_QUEUE_DURATION_MS) / OPUS_FRAME_DURATION_MS + 4)
+#define MAX_AUDIO_TASKS_IN_POOL ((MAX_ENCODE_QUEUE_DURATION_MS + MAX_PLAYBACK_QUEUE_DURATION_MS) / OPUS_FRAME_DURATION_MS + 4)
+
+// Used when CONFIG_USE_SEPARATE_OPUS_CODEC_TASKS is enabled
+#define OPUS_DECODE_TASK_PRIORITY 3
+#define OPUS_DECODE_TASK_CORE 1
+#define OPUS_ENCODE_TASK_PRIORITY 2
+#define OPUS_ENCODE_TASK_CORE 0
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// After AUDIO_STANDBY_MIN_POWER_UPS codec power-ups within AUDIO_STANDBY_WINDOW_MS the codec
+// goes to warm standby instead of off, and is switched off after AUDIO_STANDBY_TIMEOUT_MS idle
+#define AUDIO_STANDBY_MIN_POWER_UPS 3
+#define AUDIO_STANDBY_WINDOW_MS (10 * 60 * 1000)
+#define AUDIO_STANDBY_TIMEOUT_MS (5 * 60 * 1000)
 
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
@@ -56,6 +150,8 @@ struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
     std::function<void(bool)> on_vad_change;
+    // The user finished an utterance, with the detector confidence (0-100)
+    std::function<void(int)> on_utterance_end;
     std::function<void(void)> on_audio_testing_queue_full;
 };
 
@@ -70,6 +166,26 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    // When the previous pipeline stage finished (esp_timer us), for latency statistics
+    int64_t time_us = 0;
+};
+
+using AudioTaskPool = AudioObjectPool<AudioTask>;
+using AudioTaskPtr = AudioTaskPool::Ptr;
+
+enum CachedSoundState {
+    kCachedSoundPending,
+    kCachedSoundReady,
+    kCachedSoundFailed,
+};
+
+// A system sound decoded at the codec output rate, see CONFIG_USE_SOUND_PCM_CACHE.
+// AudioService::streamed_sound_ has no PCM, it stands for a sound decoded as it plays.
+struct CachedSound {
+    std::string_view ogg;
+    int16_t* pcm = nullptr;
+    size_t samples = 0;
+    std::atomic<int> state = kCachedSoundPending;
 };
 
 struct DebugStatistics {
@@ -77,6 +193,22 @@ struct DebugStatistics {
     uint32_t decode_count = 0;
     uint32_t encode_count = 0;
     uint32_t playback_count = 0;
+    // Time spent in the opus workers, including resampling of decoded audio
+    uint64_t decode_time_us = 0;
+    uint32_t decode_max_time_us = 0;
+    uint64_t encode_time_us = 0;
+    uint32_t encode_max_time_us = 0;
+    // Encoded packets the send queue had no room for
+    uint32_t send_packets_dropped = 0;
+    // Output streams started, underruns inside a stream and the DMA buffers that played dry
+    uint32_t output_streams = 0;
+    uint32_t output_underruns = 0;
+    uint32_t output_dry_buffers = 0;
+    // Audio queued before a stream starts playing, adapted to the underruns
+    uint32_t output_prefill_ms = 0;
+    // Frames in which an uncached sound had no decoded audio ready for the mixer
+    uint32_t sound_underruns = 0;
+    AudioLatencyHistogram latency[kAudioLatencyStageCount];
 };
 
 class AudioService {
@@ -88,7 +220,7 @@ public:
     void Start();
     void Stop();
     void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    AudioStreamPacketPtr PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
     bool IsIdle();
@@ -103,26 +235,63 @@ public:
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    // Feedback for CONFIG_USE_ADAPTIVE_OPUS_ENCODER, a popped packet could not be sent
+    void ReportSendFailure();
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     void SetModelsList(srmodel_list_t* models_list);
+    void PrintDebugStatistics();
+    // Record the latency of `stage` for a frame whose previous stage finished at `start_time_us`
+    void RecordLatency(AudioLatencyStage stage, int64_t start_time_us);
+    cJSON* GetLatencyStatisticsJson();
+    // Uplink frame duration for the current session, takes effect on the next captured frame
+    void SetFrameDuration(int frame_duration_ms);
+    int frame_duration_ms() const { return frame_duration_ms_; }
+    // Frame duration to propose in the next hello message
+    int GetPreferredFrameDuration();
 
 private:
     AudioCodec* codec_ = nullptr;
     AudioServiceCallbacks callbacks_;
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
+#if CONFIG_USE_SHARED_AFE
+    // Owns the AFE instance used by both the wake word and the audio processor
+    std::unique_ptr<AfeFrontEnd> afe_front_end_;
+#endif
     std::unique_ptr<AudioDebugger> audio_debugger_;
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    std::unique_ptr<AudioDecoderPool> decoder_pool_;
+    // Active entry of decoder_pool_, the resampler is nullptr when no resampling is needed
+    OpusDecoderWrapper* opus_decoder_ = nullptr;
+    PcmResampler* output_resampler_ = nullptr;
+    // Set by ResetDecoder() on any task, the decode task resets decoder_pool_ when it sees it
+    std::atomic<bool> decoder_reset_requested_ = false;
+    PcmResampler input_resampler_;
+    PcmResampler reference_resampler_;
+    // Scratch buffers for ReadAudioData, only touched by the audio input task
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> mic_buffer_;
+    std::vector<int16_t> reference_buffer_;
+    std::vector<int16_t> resampled_mic_buffer_;
+    std::vector<int16_t> resampled_reference_buffer_;
+    // Samples fed to / produced by the audio processor, the difference is the audio it holds
+    uint32_t processor_input_samples_ = 0;
+    uint32_t processor_output_samples_ = 0;
+    int64_t last_capture_time_us_ = 0;
+    // Decoder output before resampling, only touched by the opus codec task
+    std::vector<int16_t> decode_buffer_;
+    // Always empty, decoding it conceals a lost packet
+    std::vector<uint8_t> empty_payload_;
     DebugStatistics debug_statistics_;
     srmodel_list_t* models_list_ = nullptr;
+    int frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    int preferred_frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
+    uint32_t adaptive_received_packets_ = 0;
+    uint32_t adaptive_lost_packets_ = 0;
 
     EventGroupHandle_t event_group_;
 
@@ -130,15 +299,56 @@ private:
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
     TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
-    // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    std::mutex encode_producer_mutex_;
+    std::mutex decode_producer_mutex_;
+    SpscQueue<AudioStreamPacketPtr> audio_decode_queue_;
+    SpscQueue<AudioStreamPacketPtr> audio_send_queue_;
+    SpscQueue<AudioStreamPacketPtr> audio_testing_queue_;
+    SpscQueue<AudioTaskPtr> audio_encode_queue_;
+    SpscQueue<AudioTaskPtr> audio_playback_queue_;
+    // Sounds in the order they were played, producers share decode_producer_mutex_
+    SpscQueue<std::string_view> sound_queue_;
+    // Sounds handed from the opus decode task to the output task, cached PCM or &streamed_sound_
+    SpscQueue<CachedSound*> mixer_sound_queue_;
+    // Decoded packets of uncached sounds, an empty task ends a sound
+    SpscQueue<AudioTaskPtr> sound_playback_queue_;
+    CachedSound streamed_sound_;
+    // Uncached sound being decoded into sound_playback_queue_, owned by the opus decode task
+    std::atomic<bool> sound_streaming_ = false;
+    OggDemuxer sound_demuxer_;
+    std::string_view sound_stream_;
+    size_t sound_stream_position_ = 0;
+    int sound_frame_duration_ = MIN_OPUS_FRAME_DURATION_MS;
+    std::vector<uint8_t> sound_packet_;
+    std::unique_ptr<OpusDecoderWrapper> sound_decoder_;
+    PcmResampler sound_resampler_;
+#if CONFIG_USE_SOUND_PCM_CACHE
+    std::vector<std::unique_ptr<CachedSound>> sound_cache_;
+    size_t sound_cache_bytes_ = 0;
+#endif
+    // Sound being mixed over the stream by the output task
+    AudioMixer mixer_;
+    CachedSound* mixing_sound_ = nullptr;
+    // Packet being mixed when mixing_sound_ is &streamed_sound_
+    AudioTaskPtr mixing_packet_;
+    size_t mixing_sound_position_ = 0;
+    // Output task state for the underrun telemetry
+    int64_t output_dma_latency_us_ = 0;
+    int64_t output_dry_time_us_ = 0;
+    uint32_t output_dry_buffers_mark_ = 0;
+    bool output_stream_underrun_ = false;
+    // Shared by the network task (push) and the opus decoder (pop)
+    std::mutex jitter_buffer_mutex_;
+    AudioJitterBuffer jitter_buffer_;
+    // Opus encoder settings, fed by the encode task and by send failures
+    AudioEncoderController encoder_controller_;
+    AudioEndpointDetector endpoint_detector_;
+    // Only touched by the audio input task, except for the reported delay
+    AecReferenceAligner reference_aligner_;
+    MicBeamformer mic_beamformer_;
+    // For server AEC, written by the output task and read when uplink frames are stamped
+    AudioPlaybackClock playback_clock_;
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -146,16 +356,49 @@ private:
     bool service_stopped_ = true;
     bool audio_input_need_warmup_ = false;
 
+    // Input audio kept while the wake word runs, replayed into the audio processor after detection
+    PcmRingBuffer preroll_buffer_;
+    std::atomic<uint32_t> preroll_mark_ = 0;
+    std::atomic<bool> preroll_pending_ = false;
+    // Only used by the audio input task
+    bool preroll_replaying_ = false;
+    uint32_t preroll_position_ = 0;
+
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
+    // Ring of the last codec power-ups, power_up_index_ points at the oldest
+    std::chrono::steady_clock::time_point power_up_times_[AUDIO_STANDBY_MIN_POWER_UPS];
+    int power_up_index_ = 0;
+    int power_up_count_ = 0;
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void OpusCodecTask(bool decode, bool encode);
+    void DecodeNextPacket();
+    bool PrepareNextSound();
+    void StartSoundStream(const std::string_view& ogg);
+    bool DecodeSoundPacket();
+    bool HasSoundToMix();
+    void MixSounds(std::vector<int16_t>& pcm);
+    void UpdateOutputStream(const AudioTask& task);
+#if CONFIG_USE_SOUND_PCM_CACHE
+    CachedSound* FindCachedSound(const std::string_view& ogg);
+    bool FillSoundCache(CachedSound& sound);
+    void ForEachOggPacket(const std::string_view& ogg, std::function<void(int sample_rate, int frame_duration, const uint8_t* data, size_t size)> callback);
+#endif
+    void PushTaskToPlaybackQueue(AudioTaskPtr task);
+    void EncodeNextTask();
+    void ApplyEncoderSettings();
+    void UpdateWorkerStatistics(uint64_t& total_us, uint32_t& max_us, int64_t start_time);
+    static size_t FramesIn(int duration_ms, int frame_duration_ms);
+    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, uint32_t timestamp = 0);
+    void StartPrerollReplay(size_t chunk_samples);
+    void FeedPrerollToProcessor(std::vector<int16_t>& data, int samples);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
+    void OnCodecPowerUp();
+    void WakeAudioTasks();
 };
 
 #endif
\ No newline at end of file
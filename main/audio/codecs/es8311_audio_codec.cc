@@ -87,7 +87,7 @@ void Es8311AudioCodec::UpdateDeviceState() {
         ESP_ERROR_CHECK(esp_codec_dev_open(dev_, &fs));
         ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(dev_, input_gain_));
         ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(dev_, output_volume_));
-    } else if (!input_enabled_ && !output_enabled_ && dev_ != nullptr) {
+    } else if (!input_enabled_ && !output_enabled_ && !standby_ && dev_ != nullptr) {
         esp_codec_dev_close(dev_);
         dev_ = nullptr;
     }
@@ -182,6 +182,18 @@ void Es8311AudioCodec::EnableOutput(bool enable) {
     UpdateDeviceState();
 }
 
+void Es8311AudioCodec::EnableStandby(bool enable) {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (codec_if_ == nullptr) {
+        return;
+    }
+    if (enable == standby_) {
+        return;
+    }
+    AudioCodec::EnableStandby(enable);
+    UpdateDeviceState();
+}
+
 int Es8311AudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(dev_, (void*)dest, samples * sizeof(int16_t)));
@@ -37,6 +37,8 @@ public:
     virtual void SetOutputVolume(int volume) override;
     virtual void EnableInput(bool enable) override;
     virtual void EnableOutput(bool enable) override;
+    virtual void EnableStandby(bool enable) override;
+    virtual bool supports_standby() const override { return true; }
 };
 
 #endif // _ES8311_AUDIO_CODEC_H
\ No newline at end of file
@@ -144,7 +144,7 @@ void Es8388AudioCodec::EnableInput(bool enable) {
     if (enable == input_enabled_) {
         return;
     }
-    if (enable) {
+    if (enable && !input_open_) {
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
             .channel = (uint8_t) input_channels_,
@@ -162,8 +162,10 @@ void Es8388AudioCodec::EnableInput(bool enable) {
         }else{
             ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(input_dev_, input_gain_));
         }
-    } else {
+        input_open_ = true;
+    } else if (!enable && !standby_) {
         ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+        input_open_ = false;
     }
     AudioCodec::EnableInput(enable);
 }
@@ -173,7 +175,7 @@ void Es8388AudioCodec::EnableOutput(bool enable) {
     if (enable == output_enabled_) {
         return;
     }
-    if (enable) {
+    if (enable && !output_open_) {
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
             .channel = 1,
@@ -194,18 +196,34 @@ void Es8388AudioCodec::EnableOutput(bool enable) {
             ctrl_if_->write_reg(ctrl_if_, reg, 1, &reg_val, 1);
         }
 
-        if (pa_pin_ != GPIO_NUM_NC) {
-            gpio_set_level(pa_pin_, 1);
-        }
-    } else {
+        output_open_ = true;
+    } else if (!enable && !standby_) {
         ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
-        if (pa_pin_ != GPIO_NUM_NC) {
-            gpio_set_level(pa_pin_, 0);
-        }
+        output_open_ = false;
+    }
+    if (pa_pin_ != GPIO_NUM_NC) {
+        gpio_set_level(pa_pin_, enable ? 1 : 0);
     }
     AudioCodec::EnableOutput(enable);
 }
 
+void Es8388AudioCodec::EnableStandby(bool enable) {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (enable == standby_) {
+        return;
+    }
+    AudioCodec::EnableStandby(enable);
+    /* Leaving standby closes what was only kept open for it */
+    if (!enable && !input_enabled_ && input_open_) {
+        ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+        input_open_ = false;
+    }
+    if (!enable && !output_enabled_ && output_open_) {
+        ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
+        output_open_ = false;
+    }
+}
+
 int Es8388AudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
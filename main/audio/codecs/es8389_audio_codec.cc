@@ -145,7 +145,7 @@ void Es8389AudioCodec::EnableInput(bool enable) {
     if (enable == input_enabled_) {
         return;
     }
-    if (enable) {
+    if (enable && !input_open_) {
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
             .channel = 1,
@@ -155,8 +155,10 @@ void Es8389AudioCodec::EnableInput(bool enable) {
         };
         ESP_ERROR_CHECK(esp_codec_dev_open(input_dev_, &fs));
         ESP_ERROR_CHECK(esp_codec_dev_set_in_gain(input_dev_, input_gain_));
-    } else {
+        input_open_ = true;
+    } else if (!enable && !standby_) {
         ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+        input_open_ = false;
     }
     AudioCodec::EnableInput(enable);
 }
@@ -166,7 +168,7 @@ void Es8389AudioCodec::EnableOutput(bool enable) {
     if (enable == output_enabled_) {
         return;
     }
-    if (enable) {
+    if (enable && !output_open_) {
         // Play 16bit 1 channel
         esp_codec_dev_sample_info_t fs = {
             .bits_per_sample = 16,
@@ -177,18 +179,34 @@ void Es8389AudioCodec::EnableOutput(bool enable) {
         };
         ESP_ERROR_CHECK(esp_codec_dev_open(output_dev_, &fs));
         ESP_ERROR_CHECK(esp_codec_dev_set_out_vol(output_dev_, output_volume_));
-        if (pa_pin_ != GPIO_NUM_NC) {
-            gpio_set_level(pa_pin_, 1);
-        }
-    } else {
+        output_open_ = true;
+    } else if (!enable && !standby_) {
         ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
-        if (pa_pin_ != GPIO_NUM_NC) {
-            gpio_set_level(pa_pin_, 0);
-        }
+        output_open_ = false;
+    }
+    if (pa_pin_ != GPIO_NUM_NC) {
+        gpio_set_level(pa_pin_, enable ? 1 : 0);
     }
     AudioCodec::EnableOutput(enable);
 }
 
+void Es8389AudioCodec::EnableStandby(bool enable) {
+    std::lock_guard<std::mutex> lock(data_if_mutex_);
+    if (enable == standby_) {
+        return;
+    }
+    AudioCodec::EnableStandby(enable);
+    /* Leaving standby closes what was only kept open for it */
+    if (!enable && !input_enabled_ && input_open_) {
+        ESP_ERROR_CHECK(esp_codec_dev_close(input_dev_));
+        input_open_ = false;
+    }
+    if (!enable && !output_enabled_ && output_open_) {
+        ESP_ERROR_CHECK(esp_codec_dev_close(output_dev_));
+        output_open_ = false;
+    }
+}
+
 int Es8389AudioCodec::Read(int16_t* dest, int samples) {
     if (input_enabled_) {
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_codec_dev_read(input_dev_, (void*)dest, samples * sizeof(int16_t)));
@@ -18,6 +18,9 @@ private:
 
     esp_codec_dev_handle_t output_dev_ = nullptr;
     esp_codec_dev_handle_t input_dev_ = nullptr;
+    // Opened devices, kept open in standby while disabled
+    bool input_open_ = false;
+    bool output_open_ = false;
     gpio_num_t pa_pin_ = GPIO_NUM_NC;
     std::mutex data_if_mutex_;
 
@@ -35,6 +38,8 @@ public:
     virtual void SetOutputVolume(int volume) override;
     virtual void EnableInput(bool enable) override;
     virtual void EnableOutput(bool enable) override;
+    virtual void EnableStandby(bool enable) override;
+    virtual bool supports_standby() const override { return true; }
 };
 
 #endif // _ES8389_AUDIO_CODEC_H
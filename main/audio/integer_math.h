@@ -0,0 +1,30 @@
+#ifndef INTEGER_MATH_H
+#define INTEGER_MATH_H
+
+#include <cstdint>
+
+/*
+ * Integer helpers for the fixed-point DSP code (speech enhancer, beamformer), which also
+ * runs on cores without an FPU.
+ */
+
+// floor(sqrt(value)), bit by bit, at most 32 iterations
+inline uint32_t IntegerSqrt(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+#endif // INTEGER_MATH_H
@@ -0,0 +1,101 @@
+#include "mic_beamformer.h"
+#include "integer_math.h"
+
+#include <algorithm>
+#include <climits>
+
+// Keeps the NLMS normalization away from zero in silence
+#define MIN_DIFFERENCE_ENERGY (64 * 64)
+// Blocks quieter than this (RMS) leave the microphone balance alone, the noise floor may differ
+#define MIN_BALANCE_RMS 100
+// The balance corrects up to 6 dB, more than that is a broken microphone, Q14
+#define MIN_BALANCE (1 << 13)
+#define MAX_BALANCE (1 << 15)
+
+/* The two kernels run over contiguous arrays of `count` elements, once each per sample */
+static inline int32_t FilterSample(const int32_t* weights, const int16_t* input, int count) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += (int64_t)weights[i] * input[i];
+    }
+    return (int32_t)(sum >> 24);
+}
+
+static inline void UpdateWeights(int32_t* weights, const int16_t* input, int32_t gain, int count) {
+    for (int i = 0; i < count; i++) {
+        weights[i] += (int32_t)(((int64_t)gain * input[i]) >> 8);
+    }
+}
+
+MicBeamformer::MicBeamformer(int taps, int step, int adapt_ratio)
+    : taps_(taps), step_(step), adapt_ratio_(adapt_ratio) {
+}
+
+void MicBeamformer::Process(int16_t* data, size_t frames, int channels) {
+    if (channels < 2) {
+        return;
+    }
+    if (weights_.empty()) {
+        weights_.assign(taps_, 0);
+        difference_.assign(taps_ * 2, 0);
+        beam_.assign(taps_, 0);
+    }
+
+    UpdateBalance(data, frames, channels);
+
+    const size_t taps = taps_;
+    for (size_t i = 0; i < frames; i++) {
+        int16_t* frame = data + i * channels;
+        int32_t second = (frame[1] * balance_) >> 14;
+        int16_t beam = std::clamp<int32_t>((frame[0] + second) >> 1, -32768, 32767);
+        int16_t difference = std::clamp<int32_t>((frame[0] - second) >> 1, -32768, 32767);
+
+        position_ = (position_ + 1) % taps;
+        int16_t oldest = difference_[position_];
+        difference_energy_ += (int32_t)difference * difference - (int32_t)oldest * oldest;
+        difference_[position_] = difference;
+        difference_[position_ + taps] = difference;
+        beam_[position_] = beam;
+        const int16_t* history = difference_.data() + position_ + 1;
+
+        /* The beam is delayed by half the filter so the filter can reach both sides of it */
+        int32_t delayed = beam_[(position_ + taps - taps / 2) % taps];
+        int32_t error = delayed - FilterSample(weights_.data(), history, taps_);
+        error = std::clamp<int32_t>(error, -32768, 32767);
+
+        /* Voice from the front cancels in the difference, keep the filter for what does not */
+        beam_power_ += ((int32_t)beam * beam - beam_power_) >> 7;
+        difference_power_ += ((int32_t)difference * difference - difference_power_) >> 7;
+        if ((int64_t)difference_power_ * adapt_ratio_ > beam_power_) {
+            int64_t gain = ((int64_t)step_ * error << 17) / std::max<int64_t>(difference_energy_, MIN_DIFFERENCE_ENERGY);
+            gain = std::clamp<int64_t>(gain, INT32_MIN, INT32_MAX);
+            UpdateWeights(weights_.data(), history, (int32_t)gain, taps_);
+        }
+
+        frame[0] = error;
+        frame[1] = error;
+    }
+}
+
+void MicBeamformer::UpdateBalance(const int16_t* data, size_t frames, int channels) {
+    if (frames == 0) {
+        return;
+    }
+    int64_t energy[2] = {};
+    for (size_t i = 0; i < frames; i++) {
+        const int16_t* frame = data + i * channels;
+        energy[0] += (int32_t)frame[0] * frame[0];
+        energy[1] += (int32_t)frame[1] * frame[1];
+    }
+    /* Per sample levels averaged over about 16 blocks, half a second to a second at the usual sizes */
+    energy[0] /= frames;
+    energy[1] /= frames;
+    if (energy[0] < MIN_BALANCE_RMS * MIN_BALANCE_RMS || energy[1] < MIN_BALANCE_RMS * MIN_BALANCE_RMS) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        microphone_level_[i] = microphone_level_[i] == 0 ? energy[i] : microphone_level_[i] + ((energy[i] - microphone_level_[i]) >> 4);
+    }
+    uint64_t ratio = ((uint64_t)microphone_level_[0] << 28) / microphone_level_[1];
+    balance_ = std::clamp<int32_t>(IntegerSqrt(ratio), MIN_BALANCE, MAX_BALANCE);
+}
@@ -0,0 +1,55 @@
+#ifndef MIC_BEAMFORMER_H
+#define MIC_BEAMFORMER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Combines the first two microphone channels into one (CONFIG_USE_MIC_BEAMFORMER), for boards
+ * with two microphones whose front end only looks at the first channel.
+ *
+ * A generalized sidelobe canceller steered to broadside, the direction straight in front of
+ * the microphone pair: the average of the two microphones is the fixed beam, their
+ * difference holds everything that does not come from the front, and an NLMS filter on the
+ * difference removes what still correlates with the beam. Adaptation only runs while the
+ * difference carries a fair share of the power, so voice from the front, which cancels in
+ * the difference, is not learned away. The output is delayed by half the filter length.
+ *
+ * Sound from afar reaches both microphones at the same level, so the second microphone is
+ * first matched to the first by their average levels. A sensitivity mismatch of a decibel
+ * would otherwise leave enough voice in the difference for the filter to cancel it.
+ *
+ * The beam is written back into both microphone channels, so the frame layout is unchanged
+ * for everything downstream. Only the audio input task calls Process().
+ */
+class MicBeamformer {
+public:
+    MicBeamformer(int taps, int step, int adapt_ratio);
+
+    // Process `frames` interleaved frames in place, the microphones must be channels 0 and 1
+    void Process(int16_t* data, size_t frames, int channels);
+
+private:
+    const int taps_;
+    // NLMS step size, Q15
+    const int32_t step_;
+    // Adapt while the difference power is above the beam power divided by this
+    const int32_t adapt_ratio_;
+    // Q24
+    std::vector<int32_t> weights_;
+    // Difference signal, written twice so the last `taps_` samples are always contiguous
+    std::vector<int16_t> difference_;
+    std::vector<int16_t> beam_;
+    size_t position_ = 0;
+    int64_t difference_energy_ = 0;
+    int32_t beam_power_ = 0;
+    int32_t difference_power_ = 0;
+    // Level of each microphone over the last seconds, and the gain that matches the second to the first, Q14
+    int64_t microphone_level_[2] = {};
+    int32_t balance_ = 1 << 14;
+
+    void UpdateBalance(const int16_t* data, size_t frames, int channels);
+};
+
+#endif // MIC_BEAMFORMER_H
@@ -0,0 +1,233 @@
+#include "ogg_demuxer.h"
+
+#include <cstring>
+#include <algorithm>
+
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_HEADER_TYPE_CONTINUED 0x01
+
+OggDemuxer::OggDemuxer() {
+}
+
+void OggDemuxer::Reset() {
+    state_ = kStateCapture;
+    capture_matched_ = 0;
+    header_size_ = 0;
+    span_active_ = false;
+    drop_span_ = false;
+    packet_buffer_.clear();
+    seen_head_ = false;
+    seen_tags_ = false;
+    sample_rate_ = 16000;
+    channels_ = 1;
+}
+
+void OggDemuxer::OnPacket(std::function<void(const uint8_t* data, size_t size)> callback) {
+    on_packet_ = callback;
+}
+
+void OggDemuxer::Process(const uint8_t* data, size_t size) {
+    static const char capture_pattern[] = "OggS";
+
+    while (size > 0) {
+        switch (state_) {
+        case kStateCapture: {
+            if (capture_matched_ == 0) {
+                auto found = static_cast<const uint8_t*>(std::memchr(data, 'O', size));
+                if (found == nullptr) {
+                    return;
+                }
+                size -= found - data;
+                data = found;
+            }
+            if (*data == capture_pattern[capture_matched_]) {
+                capture_matched_++;
+            } else {
+                capture_matched_ = *data == 'O' ? 1 : 0;
+            }
+            data++;
+            size--;
+            if (capture_matched_ == 4) {
+                std::memcpy(header_, capture_pattern, 4);
+                header_size_ = 4;
+                capture_matched_ = 0;
+                state_ = kStateHeader;
+            }
+            break;
+        }
+        case kStateHeader: {
+            size_t count = std::min(size, OGG_PAGE_HEADER_SIZE - header_size_);
+            std::memcpy(header_ + header_size_, data, count);
+            header_size_ += count;
+            data += count;
+            size -= count;
+            if (header_size_ < OGG_PAGE_HEADER_SIZE) {
+                break;
+            }
+            if (header_[4] != 0) {
+                // Unknown stream structure version, resync on the next page
+                state_ = kStateCapture;
+                break;
+            }
+            bool continued = header_[5] & OGG_HEADER_TYPE_CONTINUED;
+            if (!continued && !packet_buffer_.empty()) {
+                // The page with the rest of the packet was lost
+                packet_buffer_.clear();
+            }
+            // A continuation without its beginning cannot be decoded
+            drop_span_ = continued && packet_buffer_.empty();
+            segment_count_ = header_[26];
+            segments_read_ = 0;
+            state_ = kStateSegments;
+            if (segment_count_ == 0) {
+                state_ = kStateCapture;
+            }
+            break;
+        }
+        case kStateSegments: {
+            size_t count = std::min(size, segment_count_ - segments_read_);
+            std::memcpy(segments_ + segments_read_, data, count);
+            segments_read_ += count;
+            data += count;
+            size -= count;
+            if (segments_read_ == segment_count_) {
+                segment_index_ = 0;
+                span_active_ = false;
+                state_ = kStateBody;
+            }
+            break;
+        }
+        case kStateBody: {
+            size_t consumed = ProcessBody(data, size);
+            data += consumed;
+            size -= consumed;
+            break;
+        }
+        }
+    }
+}
+
+void OggDemuxer::StartSpan() {
+    span_remaining_ = 0;
+    span_terminated_ = false;
+    while (segment_index_ < segment_count_) {
+        uint8_t lacing = segments_[segment_index_++];
+        span_remaining_ += lacing;
+        if (lacing < 255) {
+            span_terminated_ = true;
+            break;
+        }
+    }
+    span_active_ = true;
+}
+
+size_t OggDemuxer::ProcessBody(const uint8_t* data, size_t size) {
+    if (!span_active_) {
+        if (segment_index_ >= segment_count_) {
+            state_ = kStateCapture;
+            return 0;
+        }
+        StartSpan();
+    }
+
+    if (packet_buffer_.empty() && span_terminated_ && size >= span_remaining_) {
+        // The whole packet is in this chunk, pass it without copying
+        size_t consumed = span_remaining_;
+        if (!drop_span_) {
+            EmitPacket(data, consumed);
+        }
+        drop_span_ = false;
+        span_active_ = false;
+        return consumed;
+    }
+
+    size_t count = std::min(size, span_remaining_);
+    if (!drop_span_) {
+        packet_buffer_.insert(packet_buffer_.end(), data, data + count);
+    }
+    span_remaining_ -= count;
+    if (span_remaining_ == 0) {
+        span_active_ = false;
+        if (span_terminated_) {
+            if (!drop_span_) {
+                EmitPacket(packet_buffer_.data(), packet_buffer_.size());
+            }
+            packet_buffer_.clear();
+            drop_span_ = false;
+        }
+    }
+    return count;
+}
+
+void OggDemuxer::EmitPacket(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    if (size >= 19 && std::memcmp(data, "OpusHead", 8) == 0) {
+        // OpusHead: [8] version, [9] channel count, [10-11] pre-skip, [12-15] input sample rate
+        channels_ = data[9];
+        sample_rate_ = data[12] | (data[13] << 8) | (data[14] << 16) | (data[15] << 24);
+        seen_head_ = true;
+        seen_tags_ = false;
+        return;
+    }
+    if (!seen_head_) {
+        return;
+    }
+    if (!seen_tags_) {
+        // Audio packets start after OpusTags
+        if (size >= 8 && std::memcmp(data, "OpusTags", 8) == 0) {
+            seen_tags_ = true;
+        }
+        return;
+    }
+    if (on_packet_) {
+        on_packet_(data, size);
+    }
+}
+
+int OggDemuxer::GetOpusPacketDuration(const uint8_t* packet, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    // RFC 6716 section 3.1, frame size from the configuration number in microseconds
+    static const int silk_frame_us[] = {10000, 20000, 40000, 60000};
+    static const int hybrid_frame_us[] = {10000, 20000};
+    static const int celt_frame_us[] = {2500, 5000, 10000, 20000};
+    uint8_t toc = packet[0];
+    int config = toc >> 3;
+    int frame_us;
+    if (config < 12) {
+        frame_us = silk_frame_us[config & 3];
+    } else if (config < 16) {
+        frame_us = hybrid_frame_us[config & 1];
+    } else {
+        frame_us = celt_frame_us[config & 3];
+    }
+
+    int frames;
+    switch (toc & 3) {
+    case 0:
+        frames = 1;
+        break;
+    case 1:
+    case 2:
+        frames = 2;
+        break;
+    default:
+        if (size < 2) {
+            return 0;
+        }
+        frames = packet[1] & 0x3F;
+        break;
+    }
+    int duration_us = frame_us * frames;
+    if (duration_us == 0 || duration_us > 120000) {
+        return 0;
+    }
+    // An odd number of 2.5 ms CELT frames has no duration in whole milliseconds that the decoder accepts
+    if (duration_us % 1000 != 0) {
+        return 0;
+    }
+    return duration_us / 1000;
+}
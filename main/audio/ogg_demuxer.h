@@ -0,0 +1,70 @@
+#ifndef OGG_DEMUXER_H
+#define OGG_DEMUXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+/*
+ * Incremental Ogg/Opus demuxer.
+ *
+ * The stream can be fed in chunks of any size. Opus packets that lie entirely inside the
+ * chunk being processed are passed to the callback as a view into that chunk, so a stream
+ * that is already in memory (embedded or mmap'd flash) is demuxed without copying. Only
+ * packets split across chunks or Ogg pages are assembled in an internal buffer.
+ *
+ * OpusHead and OpusTags are consumed here, sample_rate() and channels() are valid once
+ * the first audio packet is delivered. The class has no ESP-IDF dependencies.
+ */
+class OggDemuxer {
+public:
+    OggDemuxer();
+
+    void Reset();
+    // Called for every Opus audio packet, `data` is only valid during the call
+    void OnPacket(std::function<void(const uint8_t* data, size_t size)> callback);
+    void Process(const uint8_t* data, size_t size);
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int channels() const { return channels_; }
+
+    // Duration of an Opus packet in milliseconds read from its TOC byte, 0 if invalid or not whole milliseconds
+    static int GetOpusPacketDuration(const uint8_t* packet, size_t size);
+
+private:
+    enum State {
+        kStateCapture,      // Looking for "OggS"
+        kStateHeader,       // Reading the fixed 27 byte page header
+        kStateSegments,     // Reading the lacing values
+        kStateBody,         // Reading packets
+    };
+
+    State state_ = kStateCapture;
+    size_t capture_matched_ = 0;
+    uint8_t header_[27];
+    size_t header_size_ = 0;
+    uint8_t segments_[255];
+    size_t segment_count_ = 0;
+    size_t segments_read_ = 0;
+    size_t segment_index_ = 0;
+
+    // The packet span of the current page: its bytes left, and whether it ends in this page
+    bool span_active_ = false;
+    size_t span_remaining_ = 0;
+    bool span_terminated_ = false;
+    bool drop_span_ = false;
+    std::vector<uint8_t> packet_buffer_;
+
+    bool seen_head_ = false;
+    bool seen_tags_ = false;
+    int sample_rate_ = 16000;
+    int channels_ = 1;
+    std::function<void(const uint8_t* data, size_t size)> on_packet_;
+
+    size_t ProcessBody(const uint8_t* data, size_t size);
+    void StartSpan();
+    void EmitPacket(const uint8_t* data, size_t size);
+};
+
+#endif // OGG_DEMUXER_H
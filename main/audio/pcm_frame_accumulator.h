@@ -0,0 +1,73 @@
+#ifndef PCM_FRAME_ACCUMULATOR_H
+#define PCM_FRAME_ACCUMULATOR_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+/*
+ * Cuts a stream of 16-bit PCM chunks of any size into frames of a fixed size, for audio
+ * processors whose internal block (AFE fetch, enhancer hop) does not line up with the
+ * encoder frame.
+ *
+ * Each sample is copied once, into the frame being filled. A full frame is passed to the
+ * callback as an rvalue and is cleared afterwards: callbacks that copy it leave it with its
+ * capacity, so the steady state allocates nothing. Only a callback that moves the frame
+ * away costs a new allocation for the next one.
+ *
+ * Push() and Clear() belong to the task that produces the audio, SetFrameSamples() may be
+ * called from any task and takes effect on the frame being filled.
+ */
+class PcmFrameAccumulator {
+public:
+    void SetFrameSamples(size_t samples) { frame_samples_.store(samples, std::memory_order_relaxed); }
+    inline size_t frame_samples() const { return frame_samples_.load(std::memory_order_relaxed); }
+
+    // Drop the partial frame
+    void Clear() { frame_.clear(); }
+
+    // Append `samples` samples, `on_frame(std::vector<int16_t>&&)` is called for every full frame
+    template <typename Callback>
+    void Push(const int16_t* data, size_t samples, Callback&& on_frame) {
+        const size_t frame_samples = frame_samples_.load(std::memory_order_relaxed);
+        if (frame_samples == 0) {
+            return;
+        }
+        if (frame_.capacity() < frame_samples) {
+            frame_.reserve(frame_samples);
+        }
+        while (samples > 0 || frame_.size() >= frame_samples) {
+            if (frame_.size() > frame_samples) {
+                /* Only after SetFrameSamples() shortened the frame while one was being filled */
+                spill_.assign(frame_.begin() + frame_samples, frame_.end());
+                frame_.resize(frame_samples);
+                Emit(on_frame, frame_samples);
+                frame_.insert(frame_.end(), spill_.begin(), spill_.end());
+                continue;
+            }
+            size_t count = std::min(samples, frame_samples - frame_.size());
+            frame_.insert(frame_.end(), data, data + count);
+            data += count;
+            samples -= count;
+            if (frame_.size() == frame_samples) {
+                Emit(on_frame, frame_samples);
+            }
+        }
+    }
+
+private:
+    std::atomic<size_t> frame_samples_ = 0;
+    std::vector<int16_t> frame_;
+    std::vector<int16_t> spill_;
+
+    template <typename Callback>
+    void Emit(Callback& on_frame, size_t frame_samples) {
+        on_frame(std::move(frame_));
+        frame_.clear();
+        frame_.reserve(frame_samples);
+    }
+};
+
+#endif // PCM_FRAME_ACCUMULATOR_H
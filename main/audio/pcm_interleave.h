@@ -0,0 +1,37 @@
+#ifndef PCM_INTERLEAVE_H
+#define PCM_INTERLEAVE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Split / merge 16-bit stereo PCM without temporary buffers.
+ *
+ * These are plain per-sample loops, there is no SIMD (ESP32-S3 PIE) version. Packing two
+ * samples per 32-bit word was slower on the host, where the compiler vectorizes these
+ * loops, and was never measured on the chips. What the helpers save is the vectors
+ * the input path used to allocate for each channel on every frame.
+ */
+
+inline void DeinterleaveStereo(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        left[i] = input[i * 2];
+        right[i] = input[i * 2 + 1];
+    }
+}
+
+inline void InterleaveStereo(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        output[i * 2] = left[i];
+        output[i * 2 + 1] = right[i];
+    }
+}
+
+// Keep the left channel of interleaved stereo, `output` may be the same buffer as `input`
+inline void DownmixStereoToLeft(const int16_t* input, int16_t* output, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        output[i] = input[i * 2];
+    }
+}
+
+#endif // PCM_INTERLEAVE_H
@@ -0,0 +1,94 @@
+#include "pcm_resampler.h"
+
+#include <esp_log.h>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#define TAG "PcmResampler"
+
+void PcmResampler::Configure(int input_sample_rate, int output_sample_rate, int taps) {
+    int divisor = std::gcd(input_sample_rate, output_sample_rate);
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    up_ = output_sample_rate / divisor;
+    down_ = input_sample_rate / divisor;
+    if (up_ > PCM_RESAMPLER_MAX_PHASES) {
+        ESP_LOGE(TAG, "Unsupported ratio %d -> %d, %d phases", input_sample_rate, output_sample_rate, up_);
+        up_ = 1;
+        down_ = 1;
+    }
+    /* `taps` spans the lower rate, decimation widens the filter to keep the same stopband */
+    taps_ = taps * ((down_ + up_ - 1) / up_);
+
+    /* Windowed sinc at the upsampled rate, cut off slightly below the lower Nyquist rate */
+    const int length = up_ * taps_;
+    const double cutoff = 0.5 * 0.9 / std::max(up_, down_);
+    const double center = (length - 1) / 2.0;
+    std::vector<float> prototype(length);
+    for (int k = 0; k < length; k++) {
+        double x = k - center;
+        double sinc = x == 0 ? 2 * cutoff : std::sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * std::cos(2 * M_PI * k / (length - 1)) + 0.08 * std::cos(4 * M_PI * k / (length - 1));
+        prototype[k] = sinc * window;
+    }
+
+    /* Phase p uses prototype taps p, p + up, p + 2 * up..., normalize each phase to unity gain */
+    coefficients_.resize(length);
+    for (int p = 0; p < up_; p++) {
+        double sum = 0;
+        for (int j = 0; j < taps_; j++) {
+            sum += prototype[p + j * up_];
+        }
+        int16_t* phase = &coefficients_[p * taps_];
+        int total = 0;
+        for (int j = 0; j < taps_; j++) {
+            phase[j] = std::lround(prototype[p + j * up_] / sum * 32768);
+            total += phase[j];
+        }
+        // Put the rounding error on the largest tap so the DC gain is exact
+        phase[taps_ / 2] += 32768 - total;
+    }
+    Reset();
+}
+
+void PcmResampler::Reset() {
+    buffer_.assign(taps_ - 1, 0);
+    time_ = 0;
+}
+
+int PcmResampler::GetOutputSamples(int input_samples) const {
+    uint32_t end = uint32_t(input_samples) * up_;
+    if (time_ >= end) {
+        return 0;
+    }
+    return (end - time_ + down_ - 1) / down_;
+}
+
+void PcmResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    const int history = taps_ - 1;
+    buffer_.resize(history + input_samples);
+    memcpy(buffer_.data() + history, input, input_samples * sizeof(int16_t));
+
+    /* Output t reads input i = time / up (newest) back to i - taps + 1 with phase time % up */
+    const uint32_t end = uint32_t(input_samples) * up_;
+    const int16_t* samples = buffer_.data();
+    while (time_ < end) {
+        uint32_t newest = time_ / up_;
+        const int16_t* phase = &coefficients_[(time_ % up_) * taps_];
+        const int16_t* x = samples + newest + history;
+        int32_t acc = 0;
+        for (int j = 0; j < taps_; j++) {
+            acc += int32_t(phase[j]) * x[-j];
+        }
+        acc = (acc + (1 << 14)) >> 15;
+        *output++ = acc > INT16_MAX ? INT16_MAX : (acc < INT16_MIN ? INT16_MIN : acc);
+        time_ += down_;
+    }
+    time_ -= end;
+
+    /* Keep the last `history` samples for the next block */
+    memmove(buffer_.data(), buffer_.data() + input_samples, history * sizeof(int16_t));
+    buffer_.resize(history);
+}
@@ -0,0 +1,51 @@
+#ifndef PCM_RESAMPLER_H
+#define PCM_RESAMPLER_H
+
+#include <vector>
+#include <cstdint>
+
+#ifdef CONFIG_PCM_RESAMPLER_TAPS
+#define PCM_RESAMPLER_TAPS CONFIG_PCM_RESAMPLER_TAPS
+#else
+#define PCM_RESAMPLER_TAPS 16
+#endif
+// Upper bound for the interpolation factor, 16 kHz to 44.1 kHz needs 441 phases
+#define PCM_RESAMPLER_MAX_PHASES 512
+
+/*
+ * Fixed-point polyphase FIR resampler for mono 16-bit PCM.
+ *
+ * The rate ratio is reduced to up/down (24k->16k is 2/3, 44.1k->16k is 160/441), and a
+ * windowed-sinc low-pass at the lower of the two Nyquist rates is split into `up` phases of
+ * Q15 coefficients when configured. `taps` is the filter length counted at the lower rate,
+ * so decimation uses proportionally longer phases. Each output sample is a single integer
+ * dot product, no floating point runs per sample. Every phase has unity DC gain.
+ *
+ * It is a drop-in replacement for OpusResampler: GetOutputSamples() returns exactly the
+ * number of samples the next Process() call with the same input length writes.
+ */
+class PcmResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate, int taps = PCM_RESAMPLER_TAPS);
+    void Reset();
+    int GetOutputSamples(int input_samples) const;
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int up_ = 1;
+    int down_ = 1;
+    int taps_ = 0;
+    // `up_` phases of `taps_` coefficients, each phase stored newest sample first
+    std::vector<int16_t> coefficients_;
+    // Last `taps_ - 1` input samples followed by the block being processed
+    std::vector<int16_t> buffer_;
+    // Position of the next output sample in 1/up_ input samples, from the start of the next block
+    uint32_t time_ = 0;
+};
+
+#endif // PCM_RESAMPLER_H
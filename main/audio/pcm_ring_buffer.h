@@ -0,0 +1,109 @@
+#ifndef PCM_RING_BUFFER_H
+#define PCM_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <esp_heap_caps.h>
+
+/*
+ * Fixed size circular store for 16-bit PCM that always keeps the latest samples.
+ *
+ * Samples are addressed by their absolute position in the stream (the number of samples
+ * written before them), so a reader can remember where something happened and copy the
+ * audio from that point later, as long as it has not been overwritten yet. Positions are
+ * 32-bit and wrap around, the capacity is a power of two so the wrap is seamless.
+ *
+ * One task writes, the reader may be another task: Read() fails instead of returning
+ * samples that were overwritten while it was copying them. A write still in progress is
+ * not seen, so readers should stay at least one write away from the oldest sample.
+ */
+class PcmRingBuffer {
+public:
+    PcmRingBuffer() = default;
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    ~PcmRingBuffer() {
+        if (buffer_ != nullptr) {
+            heap_caps_free(buffer_);
+        }
+    }
+
+    // Allocate room for at least `samples` samples, PSRAM is preferred when available
+    bool Allocate(size_t samples) {
+        size_t capacity = 1;
+        while (capacity < samples) {
+            capacity <<= 1;
+        }
+        if (buffer_ != nullptr) {
+            heap_caps_free(buffer_);
+        }
+        buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+        if (buffer_ == nullptr) {
+            buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_8BIT);
+        }
+        capacity_ = buffer_ != nullptr ? capacity : 0;
+        Reset();
+        return buffer_ != nullptr;
+    }
+
+    inline size_t capacity() const { return capacity_; }
+    // Position after the last written sample
+    inline uint32_t written() const { return written_.load(std::memory_order_acquire); }
+    // Number of samples that can still be read, counting back from written()
+    inline size_t stored() const { return stored_.load(std::memory_order_acquire); }
+
+    void Reset() {
+        written_.store(0, std::memory_order_release);
+        stored_.store(0, std::memory_order_release);
+    }
+
+    void Write(const int16_t* data, size_t samples) {
+        if (capacity_ == 0) {
+            return;
+        }
+        uint32_t position = written_.load(std::memory_order_relaxed);
+        if (samples > capacity_) {
+            data += samples - capacity_;
+            position += samples - capacity_;
+            samples = capacity_;
+        }
+        size_t index = position & (capacity_ - 1);
+        size_t first = std::min(samples, capacity_ - index);
+        std::memcpy(buffer_ + index, data, first * sizeof(int16_t));
+        std::memcpy(buffer_, data + first, (samples - first) * sizeof(int16_t));
+        stored_.store(std::min(stored_.load(std::memory_order_relaxed) + samples, capacity_), std::memory_order_release);
+        written_.store(position + samples, std::memory_order_release);
+    }
+
+    // Copy `samples` samples starting at `position`, fails if any of them is not available
+    bool Read(uint32_t position, int16_t* output, size_t samples) const {
+        if (!Contains(position, samples)) {
+            return false;
+        }
+        size_t index = position & (capacity_ - 1);
+        size_t first = std::min(samples, capacity_ - index);
+        std::memcpy(output, buffer_ + index, first * sizeof(int16_t));
+        std::memcpy(output + first, buffer_, (samples - first) * sizeof(int16_t));
+        // The writer may have wrapped over the range while it was copied
+        return Contains(position, samples);
+    }
+
+    bool Contains(uint32_t position, size_t samples) const {
+        uint32_t end = written();
+        size_t behind = end - position;
+        return samples <= behind && behind <= stored();
+    }
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    std::atomic<uint32_t> written_ = 0;
+    std::atomic<size_t> stored_ = 0;
+};
+
+#endif // PCM_RING_BUFFER_H
@@ -5,17 +5,23 @@
 
 #define TAG "AfeAudioProcessor"
 
-AfeAudioProcessor::AfeAudioProcessor()
-    : afe_data_(nullptr) {
+AfeAudioProcessor::AfeAudioProcessor(AfeFrontEnd* front_end)
+    : front_end_(front_end),
+      afe_data_(nullptr) {
     event_group_ = xEventGroupCreate();
 }
 
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
-    frame_samples_ = frame_duration_ms * 16000 / 1000;
+    output_frame_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
 
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    if (front_end_ != nullptr) {
+        front_end_->Initialize(codec, models_list);
+        front_end_->OnVoiceFetch([this](afe_fetch_result_t* res) {
+            HandleFetchResult(res);
+        });
+        return;
+    }
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -82,6 +88,9 @@ AfeAudioProcessor::~AfeAudioProcessor() {
 }
 
 size_t AfeAudioProcessor::GetFeedSize() {
+    if (front_end_ != nullptr) {
+        return front_end_->GetFeedSize();
+    }
     if (afe_data_ == nullptr) {
         return 0;
     }
@@ -89,18 +98,36 @@ size_t AfeAudioProcessor::GetFeedSize() {
 }
 
 void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
+    if (front_end_ != nullptr) {
+        front_end_->Feed(data.data(), data.size());
+        return;
+    }
     if (afe_data_ == nullptr) {
         return;
     }
     afe_iface_->feed(afe_data_, data.data());
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    output_frame_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+}
+
 void AfeAudioProcessor::Start() {
     xEventGroupSetBits(event_group_, PROCESSOR_RUNNING);
+    if (front_end_ != nullptr) {
+        /* Start from the next input, the audio after a wake word is fed again from the pre-roll */
+        front_end_->ResetBuffer();
+        output_frame_.Clear();
+        front_end_->EnableVoice(true);
+    }
 }
 
 void AfeAudioProcessor::Stop() {
     xEventGroupClearBits(event_group_, PROCESSOR_RUNNING);
+    if (front_end_ != nullptr) {
+        front_end_->EnableVoice(false);
+        return;
+    }
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
@@ -137,42 +164,38 @@ void AfeAudioProcessor::AudioProcessorTask() {
             }
             continue;
         }
+        HandleFetchResult(res);
+    }
+}
 
-        // VAD state change
-        if (vad_state_change_callback_) {
-            if (res->vad_state == VAD_SPEECH && !is_speaking_) {
-                is_speaking_ = true;
-                vad_state_change_callback_(true);
-            } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
-                is_speaking_ = false;
-                vad_state_change_callback_(false);
-            }
+void AfeAudioProcessor::HandleFetchResult(afe_fetch_result_t* res) {
+    // VAD state change
+    if (vad_state_change_callback_) {
+        if (res->vad_state == VAD_SPEECH && !is_speaking_) {
+            is_speaking_ = true;
+            vad_state_change_callback_(true);
+        } else if (res->vad_state == VAD_SILENCE && is_speaking_) {
+            is_speaking_ = false;
+            vad_state_change_callback_(false);
         }
+    }
 
-        if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
-            }
-        }
+    if (output_callback_) {
+        output_frame_.Push(res->data, res->data_size / sizeof(int16_t), output_callback_);
     }
 }
 
 void AfeAudioProcessor::EnableDeviceAec(bool enable) {
+    if (front_end_ != nullptr) {
+#if CONFIG_USE_DEVICE_AEC
+        front_end_->EnableDeviceAec(enable);
+#else
+        if (enable) {
+            ESP_LOGE(TAG, "Device AEC is not supported");
+        }
+#endif
+        return;
+    }
     if (enable) {
 #if CONFIG_USE_DEVICE_AEC
         afe_iface_->disable_vad(afe_data_);
@@ -12,13 +12,17 @@
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "afe_front_end.h"
+#include "pcm_frame_accumulator.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
-    AfeAudioProcessor();
+    // With a front end the AFE instance is shared with the wake word
+    AfeAudioProcessor(AfeFrontEnd* front_end = nullptr);
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -29,17 +33,19 @@ public:
     void EnableDeviceAec(bool enable) override;
 
 private:
+    AfeFrontEnd* front_end_ = nullptr;
     EventGroupHandle_t event_group_ = nullptr;
     const esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    // Cuts the AFE output into frames of the session frame duration
+    PcmFrameAccumulator output_frame_;
 
     void AudioProcessorTask();
+    void HandleFetchResult(afe_fetch_result_t* res);
 };
 
 #endif 
\ No newline at end of file
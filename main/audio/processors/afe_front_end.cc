@@ -0,0 +1,208 @@
+#include "afe_front_end.h"
+
+#include <esp_log.h>
+#include <esp_nsn_models.h>
+
+#define FRONT_END_WAKE_WORD_ENABLED 0x01
+#define FRONT_END_VOICE_ENABLED 0x02
+
+#define TAG "AfeFrontEnd"
+
+AfeFrontEnd::AfeFrontEnd() {
+    event_group_ = xEventGroupCreate();
+}
+
+AfeFrontEnd::~AfeFrontEnd() {
+    if (afe_data_ != nullptr) {
+        afe_iface_->destroy(afe_data_);
+    }
+    vEventGroupDelete(event_group_);
+}
+
+bool AfeFrontEnd::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (afe_data_ != nullptr) {
+        return true;
+    }
+
+    codec_ = codec;
+    int ref_num = codec_->input_reference() ? 1 : 0;
+
+    if (models_list == nullptr) {
+        models_ = esp_srmodel_init("model");
+    } else {
+        models_ = models_list;
+    }
+    if (models_ == nullptr || models_->num == -1) {
+        ESP_LOGE(TAG, "Failed to initialize models");
+        return false;
+    }
+    wakenet_model_ = esp_srmodel_filter(models_, ESP_WN_PREFIX, NULL);
+    char* ns_model_name = esp_srmodel_filter(models_, ESP_NSNET_PREFIX, NULL);
+    char* vad_model_name = esp_srmodel_filter(models_, ESP_VADN_PREFIX, NULL);
+
+    std::string input_format;
+    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
+        input_format.push_back('M');
+    }
+    for (int i = 0; i < ref_num; i++) {
+        input_format.push_back('R');
+    }
+
+    /* Wakenet needs the SR type, the voice output gets its AEC and NS instead of the VoIP ones */
+    afe_config_t* afe_config = afe_config_init(input_format.c_str(), models_, AFE_TYPE_SR, AFE_MODE_HIGH_PERF);
+    afe_config->aec_init = codec_->input_reference();
+    afe_config->aec_mode = AEC_MODE_SR_HIGH_PERF;
+    afe_config->vad_init = true;
+    afe_config->vad_mode = VAD_MODE_0;
+    afe_config->vad_min_noise_ms = 100;
+    if (vad_model_name != nullptr) {
+        afe_config->vad_model_name = vad_model_name;
+    }
+    if (ns_model_name != nullptr) {
+        afe_config->ns_init = true;
+        afe_config->ns_model_name = ns_model_name;
+        afe_config->afe_ns_mode = AFE_NS_MODE_NET;
+    } else {
+        afe_config->ns_init = false;
+    }
+    afe_config->agc_init = false;
+    afe_config->afe_perferred_core = 1;
+    afe_config->afe_perferred_priority = 1;
+    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+
+    afe_iface_ = esp_afe_handle_from_config(afe_config);
+    afe_data_ = afe_iface_->create_from_config(afe_config);
+    if (afe_data_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create AFE");
+        return false;
+    }
+    if (wakenet_model_ != nullptr) {
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+
+    xTaskCreate([](void* arg) {
+        auto this_ = (AfeFrontEnd*)arg;
+        this_->FrontEndTask();
+        vTaskDelete(NULL);
+    }, "audio_front_end", 4096, this, 3, nullptr);
+    return true;
+}
+
+void AfeFrontEnd::Feed(const int16_t* data, size_t samples) {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    afe_iface_->feed(afe_data_, data);
+    fed_samples_ += samples / codec_->input_channels();
+}
+
+size_t AfeFrontEnd::GetFeedSize() {
+    if (afe_data_ == nullptr) {
+        return 0;
+    }
+    return afe_iface_->get_feed_chunksize(afe_data_);
+}
+
+void AfeFrontEnd::ResetBuffer() {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    afe_iface_->reset_buffer(afe_data_);
+    fetched_samples_ = fed_samples_.load();
+}
+
+size_t AfeFrontEnd::GetUnprocessedSamples() {
+    return fed_samples_ - fetched_samples_;
+}
+
+void AfeFrontEnd::OnWakeWordFetch(std::function<void(afe_fetch_result_t* result)> callback) {
+    on_wake_word_fetch_ = callback;
+}
+
+void AfeFrontEnd::OnVoiceFetch(std::function<void(afe_fetch_result_t* result)> callback) {
+    on_voice_fetch_ = callback;
+}
+
+void AfeFrontEnd::EnableWakeWord(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (afe_data_ == nullptr || wakenet_model_ == nullptr) {
+        return;
+    }
+    if (enable) {
+        afe_iface_->enable_wakenet(afe_data_);
+        xEventGroupSetBits(event_group_, FRONT_END_WAKE_WORD_ENABLED);
+    } else {
+        xEventGroupClearBits(event_group_, FRONT_END_WAKE_WORD_ENABLED);
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+    UpdateAec();
+}
+
+void AfeFrontEnd::EnableVoice(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    if (enable) {
+        afe_iface_->reset_vad(afe_data_);
+        xEventGroupSetBits(event_group_, FRONT_END_VOICE_ENABLED);
+    } else {
+        xEventGroupClearBits(event_group_, FRONT_END_VOICE_ENABLED);
+    }
+    UpdateAec();
+}
+
+void AfeFrontEnd::EnableDeviceAec(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    device_aec_ = enable;
+    if (enable) {
+        afe_iface_->disable_vad(afe_data_);
+    } else {
+        afe_iface_->enable_vad(afe_data_);
+    }
+    UpdateAec();
+}
+
+void AfeFrontEnd::UpdateAec() {
+    if (!codec_->input_reference()) {
+        return;
+    }
+    /* Wakenet always uses the reference, voice processing only with device AEC (server AEC needs the echo) */
+    bool wake_word = xEventGroupGetBits(event_group_) & FRONT_END_WAKE_WORD_ENABLED;
+    if (wake_word || device_aec_) {
+        afe_iface_->enable_aec(afe_data_);
+    } else {
+        afe_iface_->disable_aec(afe_data_);
+    }
+}
+
+void AfeFrontEnd::FrontEndTask() {
+    auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
+    auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
+    ESP_LOGI(TAG, "Audio front end task started, feed size: %d fetch size: %d",
+        feed_size, fetch_size);
+
+    while (true) {
+        xEventGroupWaitBits(event_group_, FRONT_END_WAKE_WORD_ENABLED | FRONT_END_VOICE_ENABLED,
+            pdFALSE, pdFALSE, portMAX_DELAY);
+
+        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
+        if (res == nullptr || res->ret_value == ESP_FAIL) {
+            continue;
+        }
+        fetched_samples_ += res->data_size / sizeof(int16_t);
+
+        /* A client disabled while the fetch was waiting does not get the result */
+        EventBits_t bits = xEventGroupGetBits(event_group_);
+        if ((bits & FRONT_END_WAKE_WORD_ENABLED) && on_wake_word_fetch_) {
+            on_wake_word_fetch_(res);
+        }
+        if ((bits & FRONT_END_VOICE_ENABLED) && on_voice_fetch_) {
+            on_voice_fetch_(res);
+        }
+    }
+}
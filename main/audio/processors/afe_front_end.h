@@ -0,0 +1,67 @@
+#ifndef AFE_FRONT_END_H
+#define AFE_FRONT_END_H
+
+#include <esp_afe_sr_models.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <model_path.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "audio_codec.h"
+
+/*
+ * One AFE instance shared by AfeWakeWord and AfeAudioProcessor (CONFIG_USE_SHARED_AFE).
+ *
+ * The instance runs wakenet, AEC, NS and VAD. Both clients feed the same instance and a
+ * single task fetches the results and passes them to the clients that are enabled.
+ * Switching between wake word detection and voice processing only enables or disables
+ * wakenet, the models and buffers are kept.
+ */
+class AfeFrontEnd {
+public:
+    AfeFrontEnd();
+    ~AfeFrontEnd();
+
+    // The first client creates the instance, later calls return the same result
+    bool Initialize(AudioCodec* codec, srmodel_list_t* models_list);
+    void Feed(const int16_t* data, size_t samples);
+    size_t GetFeedSize();
+    void ResetBuffer();
+    // Samples per channel fed but not fetched yet
+    size_t GetUnprocessedSamples();
+
+    // Called from the front end task with every fetch result while the client is enabled
+    void OnWakeWordFetch(std::function<void(afe_fetch_result_t* result)> callback);
+    void OnVoiceFetch(std::function<void(afe_fetch_result_t* result)> callback);
+    void EnableWakeWord(bool enable);
+    void EnableVoice(bool enable);
+    void EnableDeviceAec(bool enable);
+
+    inline srmodel_list_t* models() const { return models_; }
+    inline const char* wakenet_model() const { return wakenet_model_; }
+
+private:
+    std::mutex mutex_;
+    EventGroupHandle_t event_group_ = nullptr;
+    srmodel_list_t* models_ = nullptr;
+    char* wakenet_model_ = nullptr;
+    const esp_afe_sr_iface_t* afe_iface_ = nullptr;
+    esp_afe_sr_data_t* afe_data_ = nullptr;
+    AudioCodec* codec_ = nullptr;
+    bool device_aec_ = false;
+    std::atomic<uint32_t> fed_samples_ = 0;
+    std::atomic<uint32_t> fetched_samples_ = 0;
+    std::function<void(afe_fetch_result_t* result)> on_wake_word_fetch_;
+    std::function<void(afe_fetch_result_t* result)> on_voice_fetch_;
+
+    void UpdateAec();
+    void FrontEndTask();
+};
+
+#endif // AFE_FRONT_END_H
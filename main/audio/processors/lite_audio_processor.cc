@@ -0,0 +1,93 @@
+#include "lite_audio_processor.h"
+#include <esp_log.h>
+
+#define TAG "LiteAudioProcessor"
+
+void LiteAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
+    codec_ = codec;
+    output_frame_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+    ESP_LOGI(TAG, "Noise suppression, AGC and VAD on %d ms hops",
+        SPEECH_ENHANCER_HOP_SAMPLES * 1000 / 16000);
+}
+
+void LiteAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    output_frame_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+}
+
+void LiteAudioProcessor::Feed(std::vector<int16_t>&& data) {
+    if (!is_running_ || !output_callback_) {
+        return;
+    }
+
+    if (restart_requested_.exchange(false)) {
+        /* Keep the noise estimate and the voice level, they still fit the room */
+        enhancer_.Restart();
+        hop_samples_ = 0;
+        output_frame_.Clear();
+        if (is_speaking_) {
+            is_speaking_ = false;
+            if (vad_state_change_callback_) {
+                vad_state_change_callback_(false);
+            }
+        }
+    }
+
+    // With several input channels only the first is processed (the microphone, or the beam of two microphones)
+    int channels = codec_->input_channels();
+    for (size_t i = 0; i < data.size(); i += channels) {
+        hop_[hop_samples_++] = data[i];
+        if (hop_samples_ == SPEECH_ENHANCER_HOP_SAMPLES) {
+            ProcessHop();
+            hop_samples_ = 0;
+        }
+    }
+}
+
+void LiteAudioProcessor::ProcessHop() {
+    enhancer_.Process(hop_, hop_);
+
+    if (enhancer_.speaking() != is_speaking_) {
+        is_speaking_ = enhancer_.speaking();
+        if (vad_state_change_callback_) {
+            vad_state_change_callback_(is_speaking_);
+        }
+    }
+
+    /* Frames do not line up with hops */
+    output_frame_.Push(hop_, SPEECH_ENHANCER_HOP_SAMPLES, output_callback_);
+}
+
+void LiteAudioProcessor::Start() {
+    restart_requested_ = true;
+    is_running_ = true;
+}
+
+void LiteAudioProcessor::Stop() {
+    is_running_ = false;
+}
+
+bool LiteAudioProcessor::IsRunning() {
+    return is_running_;
+}
+
+void LiteAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+    output_callback_ = callback;
+}
+
+void LiteAudioProcessor::OnVadStateChange(std::function<void(bool speaking)> callback) {
+    vad_state_change_callback_ = callback;
+}
+
+size_t LiteAudioProcessor::GetFeedSize() {
+    if (!codec_) {
+        return 0;
+    }
+    /* Two hops per read, an output frame waits for at most 16 ms of extra input */
+    return SPEECH_ENHANCER_HOP_SAMPLES * 2;
+}
+
+void LiteAudioProcessor::EnableDeviceAec(bool enable) {
+    if (enable) {
+        ESP_LOGE(TAG, "Device AEC is not supported");
+    }
+}
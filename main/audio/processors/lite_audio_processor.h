@@ -0,0 +1,52 @@
+#ifndef LITE_AUDIO_PROCESSOR_H
+#define LITE_AUDIO_PROCESSOR_H
+
+#include <atomic>
+#include <vector>
+#include <functional>
+
+#include "audio_processor.h"
+#include "audio_codec.h"
+#include "speech_enhancer.h"
+#include "pcm_frame_accumulator.h"
+
+/*
+ * Audio processor for boards without the ESP-SR AFE (CONFIG_USE_LITE_AUDIO_PROCESSOR).
+ *
+ * Runs the first input channel through SpeechEnhancer in the input task and reports its
+ * VAD, so these boards send cleaner audio and get the same voice events as the AFE ones.
+ */
+class LiteAudioProcessor : public AudioProcessor {
+public:
+    LiteAudioProcessor() = default;
+    ~LiteAudioProcessor() = default;
+
+    void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void SetFrameDuration(int frame_duration_ms) override;
+    void Feed(std::vector<int16_t>&& data) override;
+    void Start() override;
+    void Stop() override;
+    bool IsRunning() override;
+    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) override;
+    void OnVadStateChange(std::function<void(bool speaking)> callback) override;
+    size_t GetFeedSize() override;
+    void EnableDeviceAec(bool enable) override;
+
+private:
+    AudioCodec* codec_ = nullptr;
+    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    std::function<void(bool speaking)> vad_state_change_callback_;
+    std::atomic<bool> is_running_ = false;
+    // Set by Start(), the input task drops the old audio before the next feed
+    std::atomic<bool> restart_requested_ = false;
+    bool is_speaking_ = false;
+    SpeechEnhancer enhancer_;
+    int16_t hop_[SPEECH_ENHANCER_HOP_SAMPLES];
+    size_t hop_samples_ = 0;
+    // Cuts the enhanced hops into frames of the session frame duration
+    PcmFrameAccumulator output_frame_;
+
+    void ProcessHop();
+};
+
+#endif // LITE_AUDIO_PROCESSOR_H
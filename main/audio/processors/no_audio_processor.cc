@@ -8,15 +8,20 @@ void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmo
     frame_samples_ = frame_duration_ms * 16000 / 1000;
 }
 
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
 void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
     if (!is_running_ || !output_callback_) {
         return;
     }
 
-    if (codec_->input_channels() == 2) {
-        // If input channels is 2, we need to fetch the left channel data
-        auto mono_data = std::vector<int16_t>(data.size() / 2);
-        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
+    int channels = codec_->input_channels();
+    if (channels > 1) {
+        // With several input channels, fetch the first one (the microphone, or the beam of two microphones)
+        auto mono_data = std::vector<int16_t>(data.size() / channels);
+        for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += channels) {
             mono_data[i] = data[j];
         }
         output_callback_(std::move(mono_data));
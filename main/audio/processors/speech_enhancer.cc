@@ -0,0 +1,246 @@
+#include "speech_enhancer.h"
+#include "integer_math.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#define FFT_SIZE SPEECH_ENHANCER_FFT_SIZE
+#define HOP_SAMPLES SPEECH_ENHANCER_HOP_SAMPLES
+
+// Noise estimate of a bin below which the input counts as silent, Q4
+#define VAD_MIN_NOISE 512
+
+SpeechEnhancer::SpeechEnhancer() {
+    /* Tables are built once, the processing itself is integer only */
+    for (int i = 0; i < FFT_SIZE; i++) {
+        window_[i] = (int16_t)std::lround(32767.0 * std::sin(M_PI * i / FFT_SIZE));
+        int reversed = 0;
+        for (int bit = 1, mirror = FFT_SIZE / 2; bit < FFT_SIZE; bit <<= 1, mirror >>= 1) {
+            if (i & bit) {
+                reversed |= mirror;
+            }
+        }
+        bit_reverse_[i] = reversed;
+    }
+    for (int i = 0; i < FFT_SIZE / 2; i++) {
+        cos_[i] = (int16_t)std::lround(32767.0 * std::cos(2 * M_PI * i / FFT_SIZE));
+        sin_[i] = (int16_t)std::lround(32767.0 * std::sin(2 * M_PI * i / FFT_SIZE));
+    }
+    Reset();
+}
+
+void SpeechEnhancer::Reset() {
+    Restart();
+    std::fill(noise_, noise_ + SPEECH_ENHANCER_BINS, 0);
+    std::fill(smoothed_, smoothed_ + SPEECH_ENHANCER_BINS, 0);
+    std::fill(level_, level_ + SPEECH_ENHANCER_BINS, 0);
+    std::fill(minimum_, minimum_ + SPEECH_ENHANCER_BINS, 0);
+    std::fill(last_minimum_, last_minimum_ + SPEECH_ENHANCER_BINS, 0);
+    minimum_hops_ = 0;
+    std::fill(gain_, gain_ + SPEECH_ENHANCER_BINS, 32767);
+    noise_hops_ = 0;
+    voice_rms_ = SPEECH_ENHANCER_AGC_TARGET_RMS;
+    agc_gain_ = 256;
+}
+
+void SpeechEnhancer::Restart() {
+    std::fill(input_, input_ + FFT_SIZE, 0);
+    std::fill(overlap_, overlap_ + HOP_SAMPLES, 0);
+    speaking_ = false;
+    voice_ = false;
+    voice_hops_ = 0;
+    silence_hops_ = 0;
+}
+
+/* In place radix-2 FFT, the input must stay below 2^22 so the 8 stages cannot overflow */
+void SpeechEnhancer::Fft(int32_t* re, int32_t* im) {
+    for (int i = 0; i < FFT_SIZE; i++) {
+        int j = bit_reverse_[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (int size = 2; size <= FFT_SIZE; size <<= 1) {
+        int half = size / 2;
+        int step = FFT_SIZE / size;
+        for (int start = 0; start < FFT_SIZE; start += size) {
+            for (int k = 0; k < half; k++) {
+                int32_t w_re = cos_[k * step];
+                int32_t w_im = -sin_[k * step];
+                int a = start + k;
+                int b = a + half;
+                int32_t t_re = (int32_t)(((int64_t)re[b] * w_re - (int64_t)im[b] * w_im) >> 15);
+                int32_t t_im = (int32_t)(((int64_t)re[b] * w_im + (int64_t)im[b] * w_re) >> 15);
+                re[b] = re[a] - t_re;
+                im[b] = im[a] - t_im;
+                re[a] += t_re;
+                im[a] += t_im;
+            }
+        }
+    }
+}
+
+void SpeechEnhancer::Process(const int16_t* input, int16_t* output) {
+    std::memmove(input_, input_ + HOP_SAMPLES, HOP_SAMPLES * sizeof(int16_t));
+    std::memcpy(input_ + HOP_SAMPLES, input, HOP_SAMPLES * sizeof(int16_t));
+
+    /* Window, then scale the block up to 22 bits to keep precision through the FFT */
+    int32_t peak = 0;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        re_[i] = ((int32_t)input_[i] * window_[i]) >> 15;
+        im_[i] = 0;
+        peak = std::max(peak, std::abs(re_[i]));
+    }
+    int shift = peak > 0 ? 22 - (32 - __builtin_clz(peak)) : 0;
+    for (int i = 0; i < FFT_SIZE; i++) {
+        re_[i] <<= shift;
+    }
+    Fft(re_, im_);
+
+    /* Magnitudes back at input scale, Q4, |z| ~ max + 3/8 min is within 7% */
+    for (int k = 0; k < SPEECH_ENHANCER_BINS; k++) {
+        uint32_t a = std::abs(re_[k]);
+        uint32_t b = std::abs(im_[k]);
+        uint32_t magnitude = std::max(a, b) + (std::min(a, b) >> 2) + (std::min(a, b) >> 3);
+        magnitude_[k] = shift >= 4 ? magnitude >> (shift - 4) : magnitude << (4 - shift);
+    }
+    voice_ = UpdateSpectrum(magnitude_);
+
+    /* Apply the gains to both halves of the spectrum, then the inverse FFT is conj(FFT(conj)) / N */
+    for (int k = 0; k < SPEECH_ENHANCER_BINS; k++) {
+        int32_t gain = gain_[k];
+        re_[k] = ((int64_t)re_[k] * gain) >> 15;
+        im_[k] = ((int64_t)im_[k] * gain) >> 15;
+        if (k > 0 && k < FFT_SIZE / 2) {
+            re_[FFT_SIZE - k] = ((int64_t)re_[FFT_SIZE - k] * gain) >> 15;
+            im_[FFT_SIZE - k] = ((int64_t)im_[FFT_SIZE - k] * gain) >> 15;
+        }
+    }
+    for (int i = 0; i < FFT_SIZE; i++) {
+        re_[i] >>= 8;
+        im_[i] = -(im_[i] >> 8);
+    }
+    Fft(re_, im_);
+
+    /* Synthesis window and overlap-add with the second half of the previous block */
+    for (int i = 0; i < HOP_SAMPLES; i++) {
+        int32_t sample = (int32_t)(((int64_t)re_[i] * window_[i]) >> 15) >> shift;
+        hop_[i] = overlap_[i] + sample;
+    }
+    for (int i = HOP_SAMPLES; i < FFT_SIZE; i++) {
+        overlap_[i - HOP_SAMPLES] = (int32_t)(((int64_t)re_[i] * window_[i]) >> 15) >> shift;
+    }
+    ApplyAgc(hop_, output);
+}
+
+bool SpeechEnhancer::UpdateSpectrum(const uint32_t* magnitude) {
+    bool learning = noise_hops_ < SPEECH_ENHANCER_NOISE_INIT_HOPS;
+
+    /*
+     * Count the speech band bins well above the noise estimate from before this hop, noise
+     * alone rarely gets there in more than one or two, voiced speech does in every harmonic
+     */
+    int voice_bins = 0;
+    for (int k = SPEECH_ENHANCER_VAD_FIRST_BIN; k <= SPEECH_ENHANCER_VAD_LAST_BIN; k++) {
+        uint64_t noise = std::max<uint32_t>(noise_[k], VAD_MIN_NOISE);
+        if ((uint64_t)magnitude[k] * 256 > noise * SPEECH_ENHANCER_VAD_THRESHOLD) {
+            voice_bins++;
+        }
+    }
+    bool voice = !learning && voice_bins >= SPEECH_ENHANCER_VAD_MIN_BINS;
+    if (voice) {
+        silence_hops_ = 0;
+        if (++voice_hops_ >= SPEECH_ENHANCER_VAD_ONSET_HOPS) {
+            speaking_ = true;
+        }
+    } else {
+        voice_hops_ = 0;
+        if (speaking_ && ++silence_hops_ >= SPEECH_ENHANCER_VAD_HANGOVER_HOPS) {
+            speaking_ = false;
+        }
+    }
+
+    for (int k = 0; k < SPEECH_ENHANCER_BINS; k++) {
+        int32_t diff = (int32_t)magnitude[k] - (int32_t)noise_[k];
+        if (learning) {
+            noise_[k] = noise_hops_ == 0 ? magnitude[k] : noise_[k] + (diff >> 2);
+        } else if ((uint64_t)magnitude[k] * 256 > (uint64_t)noise_[k] * SPEECH_ENHANCER_NOISE_GATE) {
+            /* The bin holds voice, creep so that only a noise that got louder for seconds is learned */
+            noise_[k] += (diff >> 11) + 1;
+        } else {
+            /* Weak voice hides in the noise too, follow slowly while speaking */
+            noise_[k] += speaking_ ? diff >> 8 : diff >> 4;
+        }
+
+        /* Voice has gaps, the noise is at least 1.5 times the quietest level of the last seconds */
+        level_[k] += ((int32_t)magnitude[k] - (int32_t)level_[k]) >> 3;
+        minimum_[k] = std::min(minimum_[k], level_[k]);
+        if (!learning) {
+            uint32_t minimum = std::min(minimum_[k], last_minimum_[k]);
+            noise_[k] = std::max(noise_[k], minimum + (minimum >> 1));
+        }
+
+        smoothed_[k] += ((int32_t)magnitude[k] - (int32_t)smoothed_[k]) >> 1;
+        int32_t gain = SPEECH_ENHANCER_NS_FLOOR;
+        if (smoothed_[k] > 0) {
+            uint64_t ratio = ((uint64_t)noise_[k] * SPEECH_ENHANCER_NS_OVERSUBTRACT << 11) / smoothed_[k];
+            if (ratio < 32767) {
+                gain = std::max<int32_t>(32767 - ratio, SPEECH_ENHANCER_NS_FLOOR);
+            }
+        }
+        /* Open at once, close over a few hops, which keeps isolated noise peaks from chirping */
+        if (gain > gain_[k]) {
+            gain_[k] = gain;
+        } else {
+            gain_[k] -= (gain_[k] - gain) >> 1;
+        }
+    }
+    if (learning) {
+        noise_hops_++;
+    }
+    if (++minimum_hops_ >= SPEECH_ENHANCER_MINIMUM_HOPS) {
+        minimum_hops_ = 0;
+        std::copy(minimum_, minimum_ + SPEECH_ENHANCER_BINS, last_minimum_);
+        std::copy(level_, level_ + SPEECH_ENHANCER_BINS, minimum_);
+    }
+    return voice;
+}
+
+void SpeechEnhancer::ApplyAgc(const int32_t* input, int16_t* output) {
+    uint64_t energy = 0;
+    int32_t peak = 1;
+    for (int i = 0; i < HOP_SAMPLES; i++) {
+        energy += (int64_t)input[i] * input[i];
+        peak = std::max(peak, std::abs(input[i]));
+    }
+    if (voice_) {
+        int32_t rms = IntegerSqrt(energy / HOP_SAMPLES);
+        voice_rms_ += (rms - voice_rms_) >> 3;
+    }
+
+    /* Between utterances fall back to unity, boosting the residual noise would undo the NS */
+    int32_t target = 256;
+    if (speaking_) {
+        target = SPEECH_ENHANCER_AGC_TARGET_RMS * 256 / std::max<int32_t>(voice_rms_, 1);
+        target = std::clamp<int32_t>(target, 256, SPEECH_ENHANCER_AGC_MAX_GAIN * 256);
+    }
+    int32_t gain = agc_gain_;
+    if (target < gain) {
+        gain -= (gain - target) >> 2;
+    } else {
+        gain += (target - gain) >> 5;
+    }
+    gain = std::min<int32_t>(gain, (int64_t)32767 * 256 / peak);
+    gain = std::max<int32_t>(gain, 1);
+
+    /* Ramp over the hop so gain changes do not click */
+    for (int i = 0; i < HOP_SAMPLES; i++) {
+        int32_t ramp = agc_gain_ + (gain - agc_gain_) * (i + 1) / HOP_SAMPLES;
+        int32_t sample = (int32_t)(((int64_t)input[i] * ramp) >> 8);
+        output[i] = (int16_t)std::clamp<int32_t>(sample, -32768, 32767);
+    }
+    agc_gain_ = gain;
+}
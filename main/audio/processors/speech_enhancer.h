@@ -0,0 +1,98 @@
+#ifndef SPEECH_ENHANCER_H
+#define SPEECH_ENHANCER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define SPEECH_ENHANCER_FFT_SIZE 256
+#define SPEECH_ENHANCER_HOP_SAMPLES (SPEECH_ENHANCER_FFT_SIZE / 2)
+#define SPEECH_ENHANCER_BINS (SPEECH_ENHANCER_FFT_SIZE / 2 + 1)
+
+// Gain applied to bins that hold only noise, Q15 (about -16 dB)
+#define SPEECH_ENHANCER_NS_FLOOR 5000
+// Noise over-subtraction factor, Q4 (1.5)
+#define SPEECH_ENHANCER_NS_OVERSUBTRACT 24
+// A bin this far over its noise estimate holds voice and stops updating it, Q8 (+9.5 dB)
+#define SPEECH_ENHANCER_NOISE_GATE 768
+// Hops at startup used to learn the noise, assumed to be silent
+#define SPEECH_ENHANCER_NOISE_INIT_HOPS 16
+// The noise estimate is kept above the lowest level of the last one to two of these windows (1 s)
+#define SPEECH_ENHANCER_MINIMUM_HOPS 125
+
+// Speech band used by the VAD (bins of 62.5 Hz, about 300 - 4000 Hz)
+#define SPEECH_ENHANCER_VAD_FIRST_BIN 5
+#define SPEECH_ENHANCER_VAD_LAST_BIN 64
+// A bin this far over its noise estimate counts as voiced, Q8 (+6 dB), a hop needs enough of them
+#define SPEECH_ENHANCER_VAD_THRESHOLD 512
+#define SPEECH_ENHANCER_VAD_MIN_BINS 7
+#define SPEECH_ENHANCER_VAD_ONSET_HOPS 3
+#define SPEECH_ENHANCER_VAD_HANGOVER_HOPS 25
+
+// Output RMS the AGC aims for while speaking (about -20 dBFS) and its maximum gain
+#define SPEECH_ENHANCER_AGC_TARGET_RMS 3300
+#define SPEECH_ENHANCER_AGC_MAX_GAIN 6
+
+/*
+ * Noise suppression, automatic gain control and voice activity detection for 16 kHz mono
+ * audio, in integer arithmetic only, for chips without an FPU or the ESP-SR AFE.
+ *
+ * The audio is processed in hops of 128 samples (8 ms) with a 256 point FFT and square
+ * root Hann windows, which add up to unity with 50% overlap, so the output is delayed by
+ * one hop. Each bin keeps a noise estimate that follows the bin closely while it holds no
+ * voice and barely moves while it does, and is scaled by an over-subtracting
+ * spectral gain with a floor. The VAD counts the bins between 300 and 4000 Hz that stand
+ * well above their noise estimate, and the AGC brings the level measured during voice
+ * towards a target, never boosting more than a fixed gain and never clipping.
+ */
+class SpeechEnhancer {
+public:
+    SpeechEnhancer();
+
+    // Forget everything, including the noise estimate and the AGC gain
+    void Reset();
+    // Drop the buffered audio, keep what was learned about the noise and the voice level
+    void Restart();
+    // Process one hop of SPEECH_ENHANCER_HOP_SAMPLES samples, `output` may be `input`
+    void Process(const int16_t* input, int16_t* output);
+
+    inline bool speaking() const { return speaking_; }
+
+private:
+    int16_t window_[SPEECH_ENHANCER_FFT_SIZE];
+    int16_t cos_[SPEECH_ENHANCER_FFT_SIZE / 2];
+    int16_t sin_[SPEECH_ENHANCER_FFT_SIZE / 2];
+    uint8_t bit_reverse_[SPEECH_ENHANCER_FFT_SIZE];
+
+    int16_t input_[SPEECH_ENHANCER_FFT_SIZE];
+    int32_t overlap_[SPEECH_ENHANCER_HOP_SAMPLES];
+    int32_t re_[SPEECH_ENHANCER_FFT_SIZE];
+    int32_t im_[SPEECH_ENHANCER_FFT_SIZE];
+    int32_t hop_[SPEECH_ENHANCER_HOP_SAMPLES];
+
+    // Per bin magnitudes, Q4
+    uint32_t magnitude_[SPEECH_ENHANCER_BINS];
+    uint32_t noise_[SPEECH_ENHANCER_BINS];
+    uint32_t smoothed_[SPEECH_ENHANCER_BINS];
+    uint32_t level_[SPEECH_ENHANCER_BINS];
+    uint32_t minimum_[SPEECH_ENHANCER_BINS];
+    uint32_t last_minimum_[SPEECH_ENHANCER_BINS];
+    int minimum_hops_ = 0;
+    int16_t gain_[SPEECH_ENHANCER_BINS];
+    int noise_hops_ = 0;
+
+    bool speaking_ = false;
+    // The last hop was above the VAD threshold, speaking_ adds onset and hangover
+    bool voice_ = false;
+    int voice_hops_ = 0;
+    int silence_hops_ = 0;
+
+    int32_t voice_rms_ = SPEECH_ENHANCER_AGC_TARGET_RMS;
+    // Q8
+    int32_t agc_gain_ = 256;
+
+    void Fft(int32_t* re, int32_t* im);
+    bool UpdateSpectrum(const uint32_t* magnitude);
+    void ApplyAgc(const int32_t* input, int16_t* output);
+};
+
+#endif // SPEECH_ENHANCER_H
@@ -0,0 +1,172 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Producers that can block in WaitForSpace() at the same time, more of them poll every tick
+#define SPSC_QUEUE_MAX_WAITING_PRODUCERS 4
+
+/*
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * Exactly one task may call Push() and exactly one task may call Pop() at a time.
+ * Queues that have several possible producers must serialize them outside the queue.
+ * Wakeups use FreeRTOS task notifications instead of a shared condition variable:
+ * the consumer task is notified after every push, the producer task after every pop.
+ *
+ * WaitForSpace() may be called by several producers at once, each waiting task is woken.
+ *
+ * Clear() may be called from any task. It only records how far the queue should be
+ * discarded, the consumer drops those items on its next Pop() / DiscardCleared().
+ */
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : capacity_(capacity), buffer_(capacity) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    inline size_t capacity() const { return capacity_; }
+
+    // Task to notify after every push (usually the consumer)
+    void SetNotifyOnPush(TaskHandle_t task) { notify_on_push_.store(task, std::memory_order_release); }
+    // Task to notify after every pop (usually the producer)
+    void SetNotifyOnPop(TaskHandle_t task) { notify_on_pop_.store(task, std::memory_order_release); }
+
+    bool Push(T&& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+            return false;
+        }
+        buffer_[tail % capacity_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        Notify(notify_on_push_);
+        return true;
+    }
+
+    bool Pop(T& item) {
+        DiscardCleared();
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(buffer_[head % capacity_]);
+        buffer_[head % capacity_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        Notify(notify_on_pop_);
+        NotifyWaitingProducers();
+        return true;
+    }
+
+    // Consumer side: drop everything that was queued before the last Clear()
+    void DiscardCleared() {
+        if (!clear_pending_.exchange(false, std::memory_order_acq_rel)) {
+            return;
+        }
+        size_t mark = clear_mark_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (static_cast<ptrdiff_t>(mark - head) <= 0) {
+            return;
+        }
+        while (head != mark) {
+            buffer_[head % capacity_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_release);
+        Notify(notify_on_pop_);
+        NotifyWaitingProducers();
+    }
+
+    void Clear() {
+        clear_mark_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+        clear_pending_.store(true, std::memory_order_release);
+        Notify(notify_on_push_);
+        NotifyWaitingProducers();
+    }
+
+    size_t Size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        if (clear_pending_.load(std::memory_order_acquire)) {
+            size_t mark = clear_mark_.load(std::memory_order_acquire);
+            if (static_cast<ptrdiff_t>(mark - head) > 0) {
+                head = mark;
+            }
+        }
+        return tail - head;
+    }
+
+    inline bool Empty() const { return Size() == 0; }
+    inline bool Full() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire) >= capacity_; }
+
+    // Producer side: block until the queue holds fewer than `limit` items
+    bool WaitForSpace(size_t limit, TickType_t timeout = portMAX_DELAY) {
+        TickType_t start = xTaskGetTickCount();
+        int slot = -1;
+        bool result = true;
+        while (Size() >= limit || Full()) {
+            if (slot < 0) {
+                slot = AddWaitingProducer(xTaskGetCurrentTaskHandle());
+            }
+            if (Size() < limit && !Full()) {
+                break;
+            }
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (timeout != portMAX_DELAY && elapsed >= timeout) {
+                result = false;
+                break;
+            }
+            TickType_t wait = timeout == portMAX_DELAY ? portMAX_DELAY : timeout - elapsed;
+            // Nothing wakes a producer that found no free slot
+            if (slot < 0) {
+                wait = 1;
+            }
+            ulTaskNotifyTake(pdTRUE, wait);
+        }
+        if (slot >= 0) {
+            waiting_producers_[slot].store(nullptr, std::memory_order_release);
+        }
+        return result;
+    }
+
+private:
+    const size_t capacity_;
+    std::vector<T> buffer_;
+    std::atomic<size_t> head_ = 0;
+    std::atomic<size_t> tail_ = 0;
+    std::atomic<bool> clear_pending_ = false;
+    std::atomic<size_t> clear_mark_ = 0;
+    std::atomic<TaskHandle_t> notify_on_push_ = nullptr;
+    std::atomic<TaskHandle_t> notify_on_pop_ = nullptr;
+    std::atomic<TaskHandle_t> waiting_producers_[SPSC_QUEUE_MAX_WAITING_PRODUCERS] = {};
+
+    int AddWaitingProducer(TaskHandle_t task) {
+        for (int i = 0; i < SPSC_QUEUE_MAX_WAITING_PRODUCERS; i++) {
+            TaskHandle_t expected = nullptr;
+            if (waiting_producers_[i].compare_exchange_strong(expected, task, std::memory_order_acq_rel)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void NotifyWaitingProducers() {
+        for (auto& task : waiting_producers_) {
+            Notify(task);
+        }
+    }
+
+    static inline void Notify(const std::atomic<TaskHandle_t>& task) {
+        TaskHandle_t handle = task.load(std::memory_order_acquire);
+        if (handle != nullptr) {
+            xTaskNotifyGive(handle);
+        }
+    }
+};
+
+#endif // SPSC_QUEUE_H
@@ -18,6 +18,8 @@ public:
     virtual void Start() = 0;
     virtual void Stop() = 0;
     virtual size_t GetFeedSize() = 0;
+    // Samples per channel passed to Feed() that detection has not reached yet
+    virtual size_t GetUnprocessedSamples() = 0;
     virtual void EncodeWakeWordData() = 0;
     virtual bool GetWakeWordOpus(std::vector<uint8_t>& opus) = 0;
     virtual const std::string& GetLastDetectedWakeWord() const = 0;
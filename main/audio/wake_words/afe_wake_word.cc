@@ -8,10 +8,9 @@
 
 #define TAG "AfeWakeWord"
 
-AfeWakeWord::AfeWakeWord()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
+AfeWakeWord::AfeWakeWord(AfeFrontEnd* front_end)
+    : front_end_(front_end),
+      afe_data_(nullptr) {
 
     event_group_ = xEventGroupCreate();
 }
@@ -21,14 +20,6 @@ AfeWakeWord::~AfeWakeWord() {
         afe_iface_->destroy(afe_data_);
     }
 
-    if (wake_word_encode_task_stack_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_stack_);
-    }
-
-    if (wake_word_encode_task_buffer_ != nullptr) {
-        heap_caps_free(wake_word_encode_task_buffer_);
-    }
-
     if (models_ != nullptr) {
         esp_srmodel_deinit(models_);
     }
@@ -40,21 +31,23 @@ bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
     codec_ = codec;
     int ref_num = codec_->input_reference() ? 1 : 0;
 
-    if (models_list == nullptr) {
-        models_ = esp_srmodel_init("model");
-    } else {
-        models_ = models_list;
+    if (front_end_ != nullptr) {
+        if (!front_end_->Initialize(codec, models_list)) {
+            return false;
+        }
+        models_list = front_end_->models();
     }
 
-    if (models_ == nullptr || models_->num == -1) {
+    srmodel_list_t* models = models_list != nullptr ? models_list : esp_srmodel_init("model");
+    if (models == nullptr || models->num == -1) {
         ESP_LOGE(TAG, "Failed to initialize wakenet model");
         return false;
     }
-    for (int i = 0; i < models_->num; i++) {
-        ESP_LOGI(TAG, "Model %d: %s", i, models_->model_name[i]);
-        if (strstr(models_->model_name[i], ESP_WN_PREFIX) != NULL) {
-            wakenet_model_ = models_->model_name[i];
-            auto words = esp_srmodel_get_wake_words(models_, wakenet_model_);
+    for (int i = 0; i < models->num; i++) {
+        ESP_LOGI(TAG, "Model %d: %s", i, models->model_name[i]);
+        if (strstr(models->model_name[i], ESP_WN_PREFIX) != NULL) {
+            wakenet_model_ = models->model_name[i];
+            auto words = esp_srmodel_get_wake_words(models, wakenet_model_);
             // split by ";" to get all wake words
             std::stringstream ss(words);
             std::string word;
@@ -64,6 +57,19 @@ bool AfeWakeWord::Initialize(AudioCodec* codec, srmodel_list_t* models_list) {
         }
     }
 
+    if (!wake_word_encoder_.Initialize()) {
+        return false;
+    }
+
+    if (front_end_ != nullptr) {
+        front_end_->OnWakeWordFetch([this](afe_fetch_result_t* res) {
+            HandleFetchResult(res);
+        });
+        return true;
+    }
+
+    models_ = models;
+
     std::string input_format;
     for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
         input_format.push_back('M');
@@ -95,10 +101,22 @@ void AfeWakeWord::OnWakeWordDetected(std::function<void(const std::string& wake_
 }
 
 void AfeWakeWord::Start() {
+    wake_word_encoder_.Restart();
+    if (front_end_ != nullptr) {
+        front_end_->EnableWakeWord(true);
+        return;
+    }
+    /* Stop() dropped whatever was waiting in the AFE */
+    fetched_samples_ = fed_samples_.load();
     xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
 }
 
 void AfeWakeWord::Stop() {
+    if (front_end_ != nullptr) {
+        /* Keep the shared buffer, voice processing continues from it */
+        front_end_->EnableWakeWord(false);
+        return;
+    }
     xEventGroupClearBits(event_group_, DETECTION_RUNNING_EVENT);
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
@@ -106,13 +124,28 @@ void AfeWakeWord::Stop() {
 }
 
 void AfeWakeWord::Feed(const std::vector<int16_t>& data) {
+    if (front_end_ != nullptr) {
+        front_end_->Feed(data.data(), data.size());
+        return;
+    }
     if (afe_data_ == nullptr) {
         return;
     }
     afe_iface_->feed(afe_data_, data.data());
+    fed_samples_ += data.size() / codec_->input_channels();
+}
+
+size_t AfeWakeWord::GetUnprocessedSamples() {
+    if (front_end_ != nullptr) {
+        return front_end_->GetUnprocessedSamples();
+    }
+    return fed_samples_ - fetched_samples_;
 }
 
 size_t AfeWakeWord::GetFeedSize() {
+    if (front_end_ != nullptr) {
+        return front_end_->GetFeedSize();
+    }
     if (afe_data_ == nullptr) {
         return 0;
     }
@@ -132,77 +165,29 @@ void AfeWakeWord::AudioDetectionTask() {
         if (res == nullptr || res->ret_value == ESP_FAIL) {
             continue;;
         }
+        fetched_samples_ += res->data_size / sizeof(int16_t);
+        HandleFetchResult(res);
+    }
+}
 
-        // Store the wake word data for voice recognition, like who is speaking
-        StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
+void AfeWakeWord::HandleFetchResult(afe_fetch_result_t* res) {
+    // Store the wake word data for voice recognition, like who is speaking
+    wake_word_encoder_.Store(res->data, res->data_size / sizeof(int16_t));
 
-        if (res->wakeup_state == WAKENET_DETECTED) {
-            Stop();
-            last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
+    if (res->wakeup_state == WAKENET_DETECTED) {
+        Stop();
+        last_detected_wake_word_ = wake_words_[res->wakenet_model_index - 1];
 
-            if (wake_word_detected_callback_) {
-                wake_word_detected_callback_(last_detected_wake_word_);
-            }
+        if (wake_word_detected_callback_) {
+            wake_word_detected_callback_(last_detected_wake_word_);
         }
     }
 }
 
-void AfeWakeWord::StoreWakeWordData(const int16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 30ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 30) {
-        wake_word_pcm_.pop_front();
-    }
-}
-
 void AfeWakeWord::EncodeWakeWordData() {
-    const size_t stack_size = 4096 * 7;
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
-        assert(wake_word_encode_task_stack_ != nullptr);
-    }
-    if (wake_word_encode_task_buffer_ == nullptr) {
-        wake_word_encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
-        assert(wake_word_encode_task_buffer_ != nullptr);
-    }
-
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (AfeWakeWord*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            int packets = 0;
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-                packets++;
-            }
-            this_->wake_word_pcm_.clear();
-
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %d packets in %ld ms", packets, (long)((end_time - start_time) / 1000));
-
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
-        }
-        vTaskDelete(NULL);
-    }, "encode_wake_word", stack_size, this, 2, wake_word_encode_task_stack_, wake_word_encode_task_buffer_);
+    wake_word_encoder_.Finish();
 }
 
 bool AfeWakeWord::GetWakeWordOpus(std::vector<uint8_t>& opus) {
-    std::unique_lock<std::mutex> lock(wake_word_mutex_);
-    wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
-    });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    return wake_word_encoder_.GetOpus(opus);
 }
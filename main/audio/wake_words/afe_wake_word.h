@@ -9,19 +9,20 @@
 #include <esp_nsn_models.h>
 #include <model_path.h>
 
-#include <deque>
 #include <string>
 #include <vector>
 #include <functional>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "wake_word_encoder.h"
+#include "processors/afe_front_end.h"
 
 class AfeWakeWord : public WakeWord {
 public:
-    AfeWakeWord();
+    // With a front end the AFE instance is shared with the audio processor
+    AfeWakeWord(AfeFrontEnd* front_end = nullptr);
     ~AfeWakeWord();
 
     bool Initialize(AudioCodec* codec, srmodel_list_t* models_list);
@@ -30,11 +31,13 @@ public:
     void Start();
     void Stop();
     size_t GetFeedSize();
+    size_t GetUnprocessedSamples();
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
+    AfeFrontEnd* front_end_ = nullptr;
     srmodel_list_t *models_ = nullptr;
     const esp_afe_sr_iface_t* afe_iface_ = nullptr;
     esp_afe_sr_data_t* afe_data_ = nullptr;
@@ -44,17 +47,14 @@ private:
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
     AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
+    // Samples per channel fed to and fetched from the AFE, they wrap around together
+    std::atomic<uint32_t> fed_samples_ = 0;
+    std::atomic<uint32_t> fetched_samples_ = 0;
 
-    TaskHandle_t wake_word_encode_task_ = nullptr;
-    StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
-    StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
-    std::mutex wake_word_mutex_;
-    std::condition_variable wake_word_cv_;
+    WakeWordEncoder wake_word_encoder_;
 
-    void StoreWakeWordData(const int16_t* data, size_t size);
     void AudioDetectionTask();
+    void HandleFetchResult(afe_fetch_result_t* res);
 };
 
 #endif
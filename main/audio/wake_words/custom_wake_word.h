@@ -10,12 +10,11 @@
 #include <string>
 #include <vector>
 #include <functional>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
 
 #include "audio_codec.h"
 #include "wake_word.h"
+#include "wake_word_encoder.h"
 
 class CustomWakeWord : public WakeWord {
 public:
@@ -28,6 +27,7 @@ public:
     void Start();
     void Stop();
     size_t GetFeedSize();
+    size_t GetUnprocessedSamples() { return 0; }
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
@@ -54,15 +54,9 @@ private:
     std::string last_detected_wake_word_;
     std::atomic<bool> running_ = false;
 
-    TaskHandle_t wake_word_encode_task_ = nullptr;
-    StaticTask_t* wake_word_encode_task_buffer_ = nullptr;
-    StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::deque<std::vector<int16_t>> wake_word_pcm_;
-    std::deque<std::vector<uint8_t>> wake_word_opus_;
-    std::mutex wake_word_mutex_;
-    std::condition_variable wake_word_cv_;
+    WakeWordEncoder wake_word_encoder_;
+    std::vector<int16_t> mono_buffer_;
 
-    void StoreWakeWordData(const std::vector<int16_t>& data);
     void ParseWakenetModelConfig();
 };
 
@@ -24,6 +24,7 @@ public:
     void Start();
     void Stop();
     size_t GetFeedSize();
+    size_t GetUnprocessedSamples() { return 0; }
     void EncodeWakeWordData();
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
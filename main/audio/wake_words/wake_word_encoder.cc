@@ -0,0 +1,187 @@
+#include "wake_word_encoder.h"
+#include "audio_service.h"
+
+#include <esp_log.h>
+
+#define TAG "WakeWordEncoder"
+
+WakeWordEncoder::WakeWordEncoder() {
+}
+
+WakeWordEncoder::~WakeWordEncoder() {
+    if (encode_task_ != nullptr) {
+        vTaskDelete(encode_task_);
+    }
+
+    if (encode_task_stack_ != nullptr) {
+        heap_caps_free(encode_task_stack_);
+    }
+
+    if (encode_task_buffer_ != nullptr) {
+        heap_caps_free(encode_task_buffer_);
+    }
+
+    if (packet_arena_ != nullptr) {
+        heap_caps_free(packet_arena_);
+    }
+}
+
+bool WakeWordEncoder::Initialize() {
+    const size_t stack_size = 4096 * 7;
+    if (!pcm_.Allocate(16000 * WAKE_WORD_AUDIO_DURATION_MS / 1000)) {
+        ESP_LOGE(TAG, "Failed to allocate wake word audio buffer");
+        return false;
+    }
+    packet_arena_size_ = WAKE_WORD_AUDIO_DURATION_MS * WAKE_WORD_OPUS_BYTES_PER_MS;
+    packet_arena_ = (uint8_t*)heap_caps_malloc(packet_arena_size_, MALLOC_CAP_SPIRAM);
+    if (packet_arena_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate wake word packet buffer");
+        return false;
+    }
+    packets_.resize(WAKE_WORD_AUDIO_DURATION_MS / OPUS_FRAME_DURATION_MS);
+    encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+    assert(encode_task_stack_ != nullptr);
+    encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    assert(encode_task_buffer_ != nullptr);
+
+    encode_task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordEncoder*)arg;
+        this_->EncodeTask();
+        vTaskDelete(NULL);
+    }, "encode_wake_word", stack_size, this, 2, encode_task_stack_, encode_task_buffer_);
+    return true;
+}
+
+void WakeWordEncoder::Store(const int16_t* data, size_t samples) {
+    pcm_.Write(data, samples);
+    if (encode_task_ != nullptr) {
+        xTaskNotifyGive(encode_task_);
+    }
+}
+
+void WakeWordEncoder::Restart() {
+    restart_requested_ = true;
+    if (encode_task_ != nullptr) {
+        xTaskNotifyGive(encode_task_);
+    }
+}
+
+void WakeWordEncoder::Finish() {
+    finish_requested_ = true;
+    if (encode_task_ != nullptr) {
+        xTaskNotifyGive(encode_task_);
+    }
+}
+
+bool WakeWordEncoder::GetOpus(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return packet_count_ > 0 || finished_;
+    });
+    if (packet_count_ == 0) {
+        return false;
+    }
+    auto& packet = packets_[first_packet_];
+    opus.assign(packet_arena_ + packet.offset, packet_arena_ + packet.offset + packet.size);
+    PopPacket();
+    return true;
+}
+
+void WakeWordEncoder::PopPacket() {
+    first_packet_ = (first_packet_ + 1) % packets_.size();
+    packet_count_--;
+}
+
+bool WakeWordEncoder::OverlapsPacket(size_t offset, size_t size) const {
+    for (size_t i = 0; i < packet_count_; i++) {
+        auto& packet = packets_[(first_packet_ + i) % packets_.size()];
+        if (offset < packet.offset + packet.size && packet.offset < offset + size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WakeWordEncoder::PushPacket(const std::vector<uint8_t>& opus) {
+    if (opus.size() > packet_arena_size_) {
+        return;
+    }
+    if (packet_count_ == packets_.size()) {
+        PopPacket();
+    }
+
+    /* Packets are never split, one that does not fit before the end of the arena starts over at 0 */
+    size_t offset;
+    while (true) {
+        offset = 0;
+        if (packet_count_ > 0) {
+            auto& last = packets_[(first_packet_ + packet_count_ - 1) % packets_.size()];
+            offset = last.offset + last.size;
+            if (offset + opus.size() > packet_arena_size_) {
+                offset = 0;
+            }
+        }
+        if (!OverlapsPacket(offset, opus.size())) {
+            break;
+        }
+        PopPacket();
+    }
+
+    std::copy(opus.begin(), opus.end(), packet_arena_ + offset);
+    packets_[(first_packet_ + packet_count_) % packets_.size()] = { (uint32_t)offset, (uint32_t)opus.size() };
+    packet_count_++;
+}
+
+void WakeWordEncoder::EncodeTask() {
+    auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    encoder->SetComplexity(0); // 0 is the fastest
+
+    const size_t frame_samples = 16000 * OPUS_FRAME_DURATION_MS / 1000;
+    // Reused for every frame, the packets are copied into the arena
+    std::vector<int16_t> pcm;
+    std::vector<uint8_t> opus;
+    uint32_t position = 0;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (restart_requested_.exchange(false)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            first_packet_ = 0;
+            packet_count_ = 0;
+            finished_ = false;
+            encoder->ResetState();
+            position = pcm_.written();
+        }
+        if (finished_) {
+            continue;
+        }
+
+        /* Encode every whole frame stored since the last round */
+        while (true) {
+            uint32_t written = pcm_.written();
+            if (written - position > pcm_.stored()) {
+                position = written - pcm_.stored();
+            }
+            pcm.resize(frame_samples);
+            if (!pcm_.Read(position, pcm.data(), frame_samples)) {
+                break;
+            }
+            position += frame_samples;
+
+            if (!encoder->Encode(std::move(pcm), opus)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            PushPacket(opus);
+            cv_.notify_all();
+        }
+
+        if (finish_requested_.exchange(false)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+            ESP_LOGI(TAG, "Wake word audio ready: %u packets", (unsigned)packet_count_);
+            cv_.notify_all();
+        }
+    }
+}
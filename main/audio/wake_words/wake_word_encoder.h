@@ -0,0 +1,73 @@
+#ifndef WAKE_WORD_ENCODER_H
+#define WAKE_WORD_ENCODER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "pcm_ring_buffer.h"
+
+#define WAKE_WORD_AUDIO_DURATION_MS 2000
+// Packet storage per millisecond of audio, 8 bytes is 64 kbps, several times the encoder's rate
+#define WAKE_WORD_OPUS_BYTES_PER_MS 8
+
+/*
+ * Keeps the last ~2 seconds of wake word audio already Opus encoded.
+ *
+ * The detection task stores 16kHz mono PCM in a fixed circular buffer, a background task
+ * encodes it frame by frame as it arrives. When the wake word is detected only the last
+ * frame is left to encode, so the packets can be sent right away.
+ *
+ * The packets are kept in one preallocated byte arena, in order, with a table of their
+ * offsets and sizes. The oldest packets are overwritten as new ones come in, so listening
+ * for the wake word does not touch the heap.
+ */
+class WakeWordEncoder {
+public:
+    WakeWordEncoder();
+    ~WakeWordEncoder();
+
+    bool Initialize();
+    // Called by the detection task
+    void Store(const int16_t* data, size_t samples);
+    // Drop the stored audio and packets, called when detection starts again
+    void Restart();
+    // Encode the audio stored so far and end the packet stream
+    void Finish();
+    // Wait for the next packet, returns false at the end of the stream
+    bool GetOpus(std::vector<uint8_t>& opus);
+
+private:
+    PcmRingBuffer pcm_;
+    TaskHandle_t encode_task_ = nullptr;
+    StaticTask_t* encode_task_buffer_ = nullptr;
+    StackType_t* encode_task_stack_ = nullptr;
+    std::atomic<bool> restart_requested_ = false;
+    std::atomic<bool> finish_requested_ = false;
+
+    struct PacketSlot {
+        uint32_t offset;
+        uint32_t size;
+    };
+    uint8_t* packet_arena_ = nullptr;
+    size_t packet_arena_size_ = 0;
+    // Ring of the packets in the arena, oldest first
+    std::vector<PacketSlot> packets_;
+    size_t first_packet_ = 0;
+    size_t packet_count_ = 0;
+    bool finished_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    void EncodeTask();
+    // Called with mutex_ held
+    void PushPacket(const std::vector<uint8_t>& opus);
+    void PopPacket();
+    bool OverlapsPacket(size_t offset, size_t size) const;
+};
+
+#endif // WAKE_WORD_ENCODER_H
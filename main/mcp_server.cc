@@ -363,6 +363,15 @@ void McpServer::AddUserOnlyTools()
                         return true;
                     });
 
+    AddUserOnlyTool("self.audio.get_latency_stats",
+                    "Get the audio pipeline latency per stage (capture, encode, send, decode, playback) as histograms",
+                    PropertyList(),
+                    [](const PropertyList &properties) -> ReturnValue
+                    {
+                        auto &app = Application::GetInstance();
+                        return app.GetAudioService().GetLatencyStatisticsJson();
+                    });
+
     // Firmware upgrade
     AddUserOnlyTool("self.upgrade_firmware", "Upgrade firmware from a specific URL. This will download and install the firmware, then reboot the device.",
                     PropertyList({Property("url", kPropertyTypeString, "The URL of the firmware binary file to download and install")}),
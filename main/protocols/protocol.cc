@@ -8,10 +8,14 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
+void Protocol::OnAudioChannelOpening(std::function<void()> callback) {
+    on_audio_channel_opening_ = callback;
+}
+
 void Protocol::OnAudioChannelOpened(std::function<void()> callback) {
     on_audio_channel_opened_ = callback;
 }
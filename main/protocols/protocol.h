@@ -7,13 +7,23 @@
 #include <chrono>
 #include <vector>
 
+#include "audio_object_pool.h"
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    // Transport sequence number, 0 if the transport does not number its packets
+    uint32_t sequence = 0;
+    // When the previous pipeline stage finished (esp_timer us), for latency statistics
+    int64_t time_us = 0;
     std::vector<uint8_t> payload;
 };
 
+// Packets are recycled through AudioStreamPacketPool instead of the heap
+using AudioStreamPacketPool = AudioObjectPool<AudioStreamPacket>;
+using AudioStreamPacketPtr = AudioStreamPacketPool::Ptr;
+
 struct BinaryProtocol2 {
     uint16_t version;
     uint16_t type;          // Message type (0: OPUS, 1: JSON)
@@ -51,12 +61,22 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    // Uplink frame duration of the session: the one the server hello answered, else the one proposed
+    inline int session_frame_duration() const {
+        return hello_has_frame_duration_ ? server_frame_duration_ : client_frame_duration_;
+    }
+    // Uplink frame duration proposed in the next hello message
+    inline void SetClientFrameDuration(int frame_duration) {
+        client_frame_duration_ = frame_duration;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    void OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // Called inside OpenAudioChannel() once audio can be sent, before the server hello if the transport allows it
+    void OnAudioChannelOpening(std::function<void()> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -67,7 +87,7 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    virtual bool SendAudio(AudioStreamPacketPtr packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -76,7 +96,8 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<void(AudioStreamPacketPtr packet)> on_incoming_audio_;
+    std::function<void()> on_audio_channel_opening_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
@@ -85,6 +106,9 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int client_frame_duration_ = 60;
+    // Whether the last server hello carried audio_params.frame_duration
+    bool hello_has_frame_duration_ = false;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
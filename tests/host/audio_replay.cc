@@ -0,0 +1,365 @@
+/*
+ * Replays a WAV file through the audio input path on the host and reports how long each
+ * stage takes.
+ *
+ * A capture thread reads frames from WavAudioCodec and runs what AudioService::ReadAudioData
+ * runs on the device: PcmResampler with the stereo split / merge, AecReferenceAligner for a
+ * reference channel and MicBeamformer for two microphones. The frames go through an
+ * SpscQueue to a processing thread that runs the SpeechEnhancer hops of the lite audio
+ * processor and the AudioEndpointDetector, and plays the result into the codec output.
+ *
+ * Opus, the ESP-SR front end and AudioService itself need components the host build does
+ * not have, so they are not part of the replay.
+ */
+
+#include "wav_audio_codec.h"
+#include "wav_file.h"
+#include "spsc_queue.h"
+#include "pcm_resampler.h"
+#include "pcm_interleave.h"
+#include "aec_reference_aligner.h"
+#include "mic_beamformer.h"
+#include "speech_enhancer.h"
+#include "audio_endpoint_detector.h"
+
+#include <esp_timer.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// The firmware defaults from audio_service.h
+#define ENDPOINT_HANGOVER_MS 800
+#define ENDPOINT_MIN_SPEECH_MS 300
+#define ENDPOINT_MIN_CONFIDENCE 60
+#define AEC_REFERENCE_MAX_DELAY_MS 32
+#define AEC_REFERENCE_LEAD_MS 2
+#define MIC_BEAMFORMER_TAPS 16
+#define MIC_BEAMFORMER_STEP 820
+#define MIC_BEAMFORMER_ADAPT_RATIO 8
+
+#define REPLAY_QUEUE_FRAMES 16
+
+struct StageStats {
+    const char* name;
+    uint64_t calls = 0;
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+
+    explicit StageStats(const char* name) : name(name) {}
+
+    void Add(int64_t us) {
+        calls++;
+        total_us += us;
+        max_us = std::max(max_us, us);
+    }
+};
+
+struct Options {
+    std::string input;
+    std::string output;
+    double generate_seconds = 0;
+    int generate_rate = 16000;
+    int generate_channels = 1;
+    bool reference = false;
+    double seconds = 0;
+    int frame_ms = 20;
+    bool realtime = false;
+    int expect_aec_delay_ms = -1;
+};
+
+static void Usage(const char* program) {
+    std::fprintf(stderr,
+        "Usage: %s (--input FILE.wav | --generate SECONDS [--rate HZ] [--channels N]) [options]\n"
+        "  --reference       the last channel is the AEC reference\n"
+        "  --seconds S       replay S seconds, looping the input (default: its length)\n"
+        "  --frame-ms MS     capture frame duration (default: 20)\n"
+        "  --realtime        pace the codec to the sample rate instead of running flat out\n"
+        "  --output FILE.wav write the processed 16 kHz mono audio\n"
+        "  --expect-aec-delay MS  fail unless the reference was found to lead the echo by MS\n", program);
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--input" && has_value) {
+            options.input = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (arg == "--generate" && has_value) {
+            options.generate_seconds = std::atof(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            options.generate_rate = std::atoi(argv[++i]);
+        } else if (arg == "--channels" && has_value) {
+            options.generate_channels = std::atoi(argv[++i]);
+        } else if (arg == "--seconds" && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg == "--frame-ms" && has_value) {
+            options.frame_ms = std::atoi(argv[++i]);
+        } else if (arg == "--expect-aec-delay" && has_value) {
+            options.expect_aec_delay_ms = std::atoi(argv[++i]);
+        } else if (arg == "--reference") {
+            options.reference = true;
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else {
+            return false;
+        }
+    }
+    if (options.input.empty() == (options.generate_seconds <= 0)) {
+        return false;
+    }
+    return options.frame_ms > 0 && options.generate_rate > 0 &&
+        options.generate_channels >= 1 && options.generate_channels <= 4;
+}
+
+/*
+ * Synthetic input: a voice-like harmonic burst of one second in every two over a noise
+ * floor. Every microphone hears the voice at the same time, as from the front of the
+ * device, with its own noise. A reference channel carries noise that reaches the
+ * microphones as an echo 10 ms later.
+ */
+static std::vector<int16_t> GenerateInput(const Options& options) {
+    const int rate = options.generate_rate;
+    const int channels = options.generate_channels;
+    const int microphones = channels - (options.reference && channels > 1);
+    const size_t frames = options.generate_seconds * rate;
+    const size_t echo_delay = rate / 100;
+    uint32_t seed = 12345;
+    auto noise = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return static_cast<int32_t>(seed >> 16) - 32768;
+    };
+
+    // Low-passed noise, a pure tone would correlate with the echo at every period
+    std::vector<int16_t> reference(frames + echo_delay);
+    double smoothed = 0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        smoothed += (noise() / 3.0 - smoothed) * 4000 / rate;
+        reference[i] = smoothed;
+    }
+
+    std::vector<int16_t> samples(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        double t = static_cast<double>(i) / rate;
+        double voice = 0;
+        if (static_cast<int>(t) % 2 == 0) {
+            double envelope = 0.5 + 0.5 * std::sin(2 * M_PI * 4 * t);
+            for (int harmonic = 1; harmonic <= 10; harmonic++) {
+                voice += std::sin(2 * M_PI * 150 * harmonic * t) / harmonic;
+            }
+            voice *= 6000 * envelope;
+        }
+        for (int channel = 0; channel < microphones; channel++) {
+            double echo = options.reference ? 0.3 * reference[i] : 0;
+            samples[i * channels + channel] = std::clamp<double>(voice + echo + noise() / 100, -32768, 32767);
+        }
+        if (microphones < channels) {
+            samples[i * channels + channels - 1] = reference[i + echo_delay];
+        }
+    }
+    return samples;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    std::string wav;
+    if (!options.input.empty()) {
+        if (!ReadFile(options.input, wav)) {
+            std::fprintf(stderr, "Cannot read %s\n", options.input.c_str());
+            return 2;
+        }
+    } else {
+        wav = MakeWav(GenerateInput(options), options.generate_rate, options.generate_channels);
+    }
+
+    WavAudioCodec codec(wav, 16000, options.reference, options.realtime);
+    if (!codec.valid()) {
+        return 2;
+    }
+    const int input_rate = codec.input_sample_rate();
+    const int channels = codec.input_channels();
+    if (input_rate != 16000 && channels > 2) {
+        // AudioService resamples mono and stereo input only
+        std::fprintf(stderr, "%d channels at %d Hz are not supported, only 16 kHz input may have more than two\n",
+            channels, input_rate);
+        return 2;
+    }
+    if (options.seconds <= 0) {
+        options.seconds = static_cast<double>(codec.wav_frames()) / input_rate;
+    }
+    const int frame_samples = options.frame_ms * 16000 / 1000;
+    const size_t total_frames = std::max<size_t>(1, options.seconds * 1000 / options.frame_ms);
+    codec.Start();
+
+    StageStats read_stats("read"), resample_stats("resample"), align_stats("aec align"),
+        beamform_stats("beamform"), queue_stats("queue wait"), enhance_stats("enhance"),
+        endpoint_stats("endpoint"), output_stats("output");
+    size_t queue_max = 0;
+    uint64_t queue_sum = 0;
+    SpscQueue<std::vector<int16_t>> queue(REPLAY_QUEUE_FRAMES);
+    std::vector<int16_t> processed;
+    int endpoints = 0;
+    size_t hops = 0;
+    size_t captured_samples = 0;
+    int64_t start_time = esp_timer_get_time();
+
+    std::thread processing([&]() {
+        queue.SetNotifyOnPush(xTaskGetCurrentTaskHandle());
+        SpeechEnhancer enhancer;
+        AudioEndpointDetector detector(ENDPOINT_HANGOVER_MS, ENDPOINT_MIN_SPEECH_MS, ENDPOINT_MIN_CONFIDENCE);
+        std::vector<int16_t> frame;
+        std::vector<int16_t> pending;
+        std::vector<int16_t> hop(SPEECH_ENHANCER_HOP_SAMPLES);
+        while (true) {
+            if (!queue.Pop(frame)) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+            if (frame.empty()) {
+                break;
+            }
+            // The audio processor only looks at the first microphone
+            size_t frames = frame.size() / channels;
+            for (size_t i = 0; i < frames; i++) {
+                pending.push_back(frame[i * channels]);
+            }
+            size_t offset = 0;
+            for (; offset + SPEECH_ENHANCER_HOP_SAMPLES <= pending.size(); offset += SPEECH_ENHANCER_HOP_SAMPLES) {
+                int64_t t0 = esp_timer_get_time();
+                enhancer.Process(pending.data() + offset, hop.data());
+                int64_t t1 = esp_timer_get_time();
+                if (detector.OnFrame(SPEECH_ENHANCER_HOP_SAMPLES * 1000 / 16000, enhancer.speaking())) {
+                    endpoints++;
+                    detector.Reset();
+                }
+                int64_t t2 = esp_timer_get_time();
+                codec.OutputData(hop);
+                int64_t t3 = esp_timer_get_time();
+                enhance_stats.Add(t1 - t0);
+                endpoint_stats.Add(t2 - t1);
+                output_stats.Add(t3 - t2);
+                if (!options.output.empty()) {
+                    processed.insert(processed.end(), hop.begin(), hop.end());
+                }
+                hops++;
+            }
+            pending.erase(pending.begin(), pending.begin() + offset);
+        }
+    });
+
+    PcmResampler input_resampler, reference_resampler;
+    input_resampler.Configure(input_rate, 16000);
+    reference_resampler.Configure(input_rate, 16000);
+    AecReferenceAligner reference_aligner(AEC_REFERENCE_MAX_DELAY_MS, AEC_REFERENCE_LEAD_MS);
+    MicBeamformer mic_beamformer(MIC_BEAMFORMER_TAPS, MIC_BEAMFORMER_STEP, MIC_BEAMFORMER_ADAPT_RATIO);
+    std::vector<int16_t> input_buffer, mic_buffer, reference_buffer, resampled_mic_buffer, resampled_reference_buffer;
+
+    for (size_t n = 0; n < total_frames; n++) {
+        std::vector<int16_t> data;
+        int64_t t0 = esp_timer_get_time();
+        if (input_rate != 16000) {
+            input_buffer.resize(frame_samples * input_rate / 16000 * channels);
+            codec.InputData(input_buffer);
+            int64_t t1 = esp_timer_get_time();
+            read_stats.Add(t1 - t0);
+            if (channels == 2) {
+                size_t frames = input_buffer.size() / 2;
+                mic_buffer.resize(frames);
+                reference_buffer.resize(frames);
+                DeinterleaveStereo(input_buffer.data(), mic_buffer.data(), reference_buffer.data(), frames);
+                resampled_mic_buffer.resize(input_resampler.GetOutputSamples(frames));
+                resampled_reference_buffer.resize(reference_resampler.GetOutputSamples(frames));
+                input_resampler.Process(mic_buffer.data(), frames, resampled_mic_buffer.data());
+                reference_resampler.Process(reference_buffer.data(), frames, resampled_reference_buffer.data());
+                size_t resampled_frames = std::min(resampled_mic_buffer.size(), resampled_reference_buffer.size());
+                data.resize(resampled_frames * 2);
+                InterleaveStereo(resampled_mic_buffer.data(), resampled_reference_buffer.data(), data.data(), resampled_frames);
+            } else {
+                data.resize(input_resampler.GetOutputSamples(input_buffer.size()));
+                input_resampler.Process(input_buffer.data(), input_buffer.size(), data.data());
+            }
+            resample_stats.Add(esp_timer_get_time() - t1);
+        } else {
+            data.resize(frame_samples * channels);
+            codec.InputData(data);
+            read_stats.Add(esp_timer_get_time() - t0);
+        }
+
+        size_t frames = data.size() / channels;
+        captured_samples += frames;
+        if (codec.input_reference()) {
+            int64_t t = esp_timer_get_time();
+            reference_aligner.Process(data.data(), frames, channels);
+            align_stats.Add(esp_timer_get_time() - t);
+        }
+        if (channels - codec.input_reference() >= 2) {
+            int64_t t = esp_timer_get_time();
+            mic_beamformer.Process(data.data(), frames, channels);
+            beamform_stats.Add(esp_timer_get_time() - t);
+        }
+
+        int64_t t = esp_timer_get_time();
+        queue.WaitForSpace(queue.capacity());
+        queue_stats.Add(esp_timer_get_time() - t);
+        queue.Push(std::move(data));
+        size_t size = queue.Size();
+        queue_sum += size;
+        queue_max = std::max(queue_max, size);
+    }
+    queue.WaitForSpace(queue.capacity());
+    queue.Push(std::vector<int16_t>());
+    processing.join();
+
+    double wall_seconds = (esp_timer_get_time() - start_time) / 1e6;
+    double audio_seconds = total_frames * options.frame_ms / 1000.0;
+    std::printf("Replayed %.1f s of %d Hz, %d channel input%s in %.3f s: %.0f frames/s, %.1fx real time\n",
+        audio_seconds, input_rate, channels, codec.input_reference() ? " with reference" : "",
+        wall_seconds, total_frames / wall_seconds, audio_seconds / wall_seconds);
+    std::printf("%-12s %8s %10s %10s %8s\n", "stage", "calls", "avg us", "max us", "cpu %");
+    for (auto stats : { &read_stats, &resample_stats, &align_stats, &beamform_stats, &queue_stats,
+            &enhance_stats, &endpoint_stats, &output_stats }) {
+        if (stats->calls == 0) {
+            continue;
+        }
+        std::printf("%-12s %8llu %10.2f %10lld %8.3f\n", stats->name, (unsigned long long)stats->calls,
+            (double)stats->total_us / stats->calls, (long long)stats->max_us, stats->total_us / (audio_seconds * 1e4));
+    }
+    std::printf("queue: %.2f frames on average, %zu at most, capacity %zu\n",
+        (double)queue_sum / total_frames, queue_max, queue.capacity());
+    if (codec.input_reference()) {
+        std::printf("aec reference: delay %d us, shift %d samples\n",
+            (int)reference_aligner.delay_us(), reference_aligner.shift_samples());
+    }
+    std::printf("endpoints: %d\n", endpoints);
+
+    if (!options.output.empty() && !WriteFile(options.output, MakeWav(processed, 16000, 1))) {
+        std::fprintf(stderr, "Cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    if (options.expect_aec_delay_ms >= 0 &&
+            std::abs(reference_aligner.delay_us() - options.expect_aec_delay_ms * 1000) > 1000) {
+        std::fprintf(stderr, "AEC reference delay not found, expected %d ms\n", options.expect_aec_delay_ms);
+        return 1;
+    }
+
+    // Every captured sample must come out of the processor, except the last partial hop
+    size_t expected_hops = captured_samples / SPEECH_ENHANCER_HOP_SAMPLES;
+    if (hops != expected_hops || codec.output_samples() != hops * SPEECH_ENHANCER_HOP_SAMPLES) {
+        std::fprintf(stderr, "Lost audio: %zu hops processed, %zu expected\n", hops, expected_hops);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Stereo split / merge of the input path, before and after pcm_interleave.h.
+ *
+ * "old" is the code ReadAudioData ran before: per-sample loops into vectors allocated for
+ * every frame. "word" is the first version of the helpers, which packed two samples per
+ * 32-bit word, into reused buffers. "new" is DeinterleaveStereo / InterleaveStereo into
+ * reused buffers. All three must produce the same samples. The host CPU and compiler differ
+ * from the Xtensa and RISC-V targets, so only the relative numbers carry over, and roughly.
+ */
+
+#include "pcm_interleave.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+// Defeats dead code elimination of the benchmark loops
+static volatile int16_t sink;
+
+static void DeinterleaveStereoWords(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t first, second;
+        std::memcpy(&first, input + i * 2, sizeof(first));
+        std::memcpy(&second, input + i * 2 + 2, sizeof(second));
+        uint32_t left_pair = (first & 0xFFFF) | (second << 16);
+        uint32_t right_pair = (first >> 16) | (second & 0xFFFF0000);
+        std::memcpy(left + i, &left_pair, sizeof(left_pair));
+        std::memcpy(right + i, &right_pair, sizeof(right_pair));
+    }
+    for (; i < frames; ++i) {
+        left[i] = input[i * 2];
+        right[i] = input[i * 2 + 1];
+    }
+}
+
+static void InterleaveStereoWords(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        uint32_t left_pair, right_pair;
+        std::memcpy(&left_pair, left + i, sizeof(left_pair));
+        std::memcpy(&right_pair, right + i, sizeof(right_pair));
+        uint32_t first = (left_pair & 0xFFFF) | (right_pair << 16);
+        uint32_t second = (left_pair >> 16) | (right_pair & 0xFFFF0000);
+        std::memcpy(output + i * 2, &first, sizeof(first));
+        std::memcpy(output + i * 2 + 2, &second, sizeof(second));
+    }
+    for (; i < frames; ++i) {
+        output[i * 2] = left[i];
+        output[i * 2 + 1] = right[i];
+    }
+}
+
+static double MeasureSamplesPerSecond(size_t frames, int iterations, const std::function<void()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return frames * 2.0 * iterations / elapsed.count();
+}
+
+static bool BenchmarkFrame(size_t frames, int iterations) {
+    std::vector<int16_t> input(frames * 2);
+    uint32_t seed = 1;
+    for (auto& sample : input) {
+        seed = seed * 1664525 + 1013904223;
+        sample = seed >> 16;
+    }
+
+    std::vector<int16_t> old_output, word_output(frames * 2), new_output(frames * 2);
+    std::vector<int16_t> left(frames), right(frames);
+
+    auto run_old = [&]() {
+        auto mic_channel = std::vector<int16_t>(input.size() / 2);
+        auto reference_channel = std::vector<int16_t>(input.size() / 2);
+        for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+            mic_channel[i] = input[j];
+            reference_channel[i] = input[j + 1];
+        }
+        // The resampler wrote into two more vectors of the same kind
+        auto resampled_mic = std::vector<int16_t>(mic_channel);
+        auto resampled_reference = std::vector<int16_t>(reference_channel);
+        old_output.resize(resampled_mic.size() + resampled_reference.size());
+        for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+            old_output[j] = resampled_mic[i];
+            old_output[j + 1] = resampled_reference[i];
+        }
+        sink = old_output[frames];
+    };
+    auto run_word = [&]() {
+        DeinterleaveStereoWords(input.data(), left.data(), right.data(), frames);
+        InterleaveStereoWords(left.data(), right.data(), word_output.data(), frames);
+        sink = word_output[frames];
+    };
+    auto run_new = [&]() {
+        DeinterleaveStereo(input.data(), left.data(), right.data(), frames);
+        InterleaveStereo(left.data(), right.data(), new_output.data(), frames);
+        sink = new_output[frames];
+    };
+
+    double old_rate = MeasureSamplesPerSecond(frames, iterations, run_old);
+    double word_rate = MeasureSamplesPerSecond(frames, iterations, run_word);
+    double new_rate = MeasureSamplesPerSecond(frames, iterations, run_new);
+    std::printf("%6zu frames: old %8.1f, word %8.1f, new %8.1f Msamples/s (%.2fx old, %.2fx word)\n",
+        frames, old_rate / 1e6, word_rate / 1e6, new_rate / 1e6, new_rate / old_rate, new_rate / word_rate);
+
+    bool same = old_output == input && word_output == input && new_output == input;
+    DownmixStereoToLeft(new_output.data(), new_output.data(), frames);
+    for (size_t i = 0; i < frames; i++) {
+        same = same && new_output[i] == input[i * 2];
+    }
+    if (!same) {
+        std::fprintf(stderr, "%zu frames: the outputs differ\n", frames);
+    }
+    return same;
+}
+
+int main(int argc, char** argv) {
+    // Enough work per size for stable numbers, a short run with --quick for ctest
+    int samples = argc > 1 && std::strcmp(argv[1], "--quick") == 0 ? 1000000 : 200000000;
+    bool ok = true;
+    // 20 ms frames at 16, 44.1 and 48 kHz, a 60 ms frame at 48 kHz and odd sizes for the tail loop
+    for (size_t frames : { 320, 441, 960, 2880, 1, 3, 999 }) {
+        ok = BenchmarkFrame(frames, std::max<int>(1, samples / (frames * 2))) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+ * Cost and quality of PcmResampler at the rates the firmware converts between.
+ *
+ * For each ratio and filter length it reports the multiply-accumulates per output sample,
+ * the output samples per second on this host, and three measurements on sine waves: the
+ * gain and SINAD (signal to noise and distortion) of a 1 kHz tone, and for decimation the
+ * rejection of a tone above the output Nyquist rate, which would otherwise alias into the
+ * voice band.
+ */
+
+#include "pcm_resampler.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+// Defeats dead code elimination of the benchmark loop
+static volatile int16_t sink;
+
+static std::vector<int16_t> Sine(double frequency, int sample_rate, size_t samples, double amplitude) {
+    std::vector<int16_t> sine(samples);
+    for (size_t i = 0; i < samples; i++) {
+        sine[i] = std::lround(amplitude * std::sin(2 * M_PI * frequency * i / sample_rate));
+    }
+    return sine;
+}
+
+// Resample in 20 ms blocks, as the audio tasks do
+static std::vector<int16_t> Resample(PcmResampler& resampler, const std::vector<int16_t>& input) {
+    resampler.Reset();
+    const size_t block = resampler.input_sample_rate() / 50;
+    std::vector<int16_t> output;
+    for (size_t offset = 0; offset < input.size(); offset += block) {
+        int count = std::min(block, input.size() - offset);
+        size_t size = output.size();
+        output.resize(size + resampler.GetOutputSamples(count));
+        resampler.Process(input.data() + offset, count, output.data() + size);
+    }
+    return output;
+}
+
+// Least squares fit of a sine at `frequency`, returns its power and the power of the rest
+static void FitSine(const int16_t* samples, size_t count, double frequency, int sample_rate,
+        double& tone_power, double& residual_power) {
+    double ss = 0, sc = 0, cc = 0, xs = 0, xc = 0;
+    for (size_t i = 0; i < count; i++) {
+        double s = std::sin(2 * M_PI * frequency * i / sample_rate);
+        double c = std::cos(2 * M_PI * frequency * i / sample_rate);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        xs += samples[i] * s;
+        xc += samples[i] * c;
+    }
+    double determinant = ss * cc - sc * sc;
+    double a = (xs * cc - xc * sc) / determinant;
+    double b = (xc * ss - xs * sc) / determinant;
+    tone_power = 0;
+    residual_power = 0;
+    for (size_t i = 0; i < count; i++) {
+        double fit = a * std::sin(2 * M_PI * frequency * i / sample_rate) + b * std::cos(2 * M_PI * frequency * i / sample_rate);
+        tone_power += fit * fit;
+        residual_power += (samples[i] - fit) * (samples[i] - fit);
+    }
+    tone_power /= count;
+    residual_power /= count;
+}
+
+static double Power(const int16_t* samples, size_t count) {
+    double power = 0;
+    for (size_t i = 0; i < count; i++) {
+        power += (double)samples[i] * samples[i];
+    }
+    return power / count;
+}
+
+static bool Benchmark(int input_rate, int output_rate, int taps, double seconds) {
+    PcmResampler resampler;
+    resampler.Configure(input_rate, output_rate, taps);
+    int divisor = std::gcd(input_rate, output_rate);
+    int up = output_rate / divisor, down = input_rate / divisor;
+    int macs = taps * ((down + up - 1) / up);
+
+    // Throughput on noise, all phases are used
+    std::vector<int16_t> noise(input_rate / 50);
+    uint32_t seed = 1;
+    for (auto& sample : noise) {
+        seed = seed * 1664525 + 1013904223;
+        sample = (int32_t)(seed >> 16) - 32768;
+    }
+    std::vector<int16_t> output(resampler.GetOutputSamples(noise.size()) + 1);
+    size_t blocks = std::max<size_t>(1, seconds * 50);
+    size_t produced = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < blocks; i++) {
+        int count = resampler.GetOutputSamples(noise.size());
+        resampler.Process(noise.data(), noise.size(), output.data());
+        produced += count;
+        sink = output[0];
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double rate = produced / elapsed.count();
+
+    // One second of each tone, measured after the first 100 ms
+    const double amplitude = 16384;
+    const size_t skip = output_rate / 10;
+    auto tone = Resample(resampler, Sine(1000, input_rate, input_rate, amplitude));
+    bool ok = tone.size() == (size_t)output_rate;
+    double tone_power = 0, residual_power = 0;
+    FitSine(tone.data() + skip, tone.size() - skip, 1000, output_rate, tone_power, residual_power);
+    double gain_db = 10 * std::log10(tone_power / (amplitude * amplitude / 2));
+    double sinad_db = 10 * std::log10(tone_power / residual_power);
+    ok = ok && std::fabs(gain_db) < 0.5;
+
+    char rejection[16] = "-";
+    if (output_rate < input_rate) {
+        // About halfway between the output and the input Nyquist rates, off any exact ratio
+        double frequency = (output_rate + input_rate) / 4.0 + 123;
+        auto alias = Resample(resampler, Sine(frequency, input_rate, input_rate, amplitude));
+        double alias_db = 10 * std::log10((amplitude * amplitude / 2) / Power(alias.data() + skip, alias.size() - skip));
+        std::snprintf(rejection, sizeof(rejection), "%.1f", alias_db);
+    }
+
+    std::printf("%6d -> %-6d %5d %8d %12.1f %9.2f %9.1f %10s\n", input_rate, output_rate, taps, macs,
+        rate / 1e6, gain_db, sinad_db, rejection);
+    if (!ok) {
+        std::fprintf(stderr, "%d -> %d with %d taps: %zu samples, gain %.2f dB\n", input_rate, output_rate,
+            taps, tone.size(), gain_db);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 && std::strcmp(argv[1], "--quick") == 0 ? 1 : 200;
+    static const int ratios[][2] = {
+        {48000, 16000}, {44100, 16000}, {24000, 16000}, {16000, 24000}, {16000, 44100}, {16000, 48000},
+    };
+    std::printf("%-16s %5s %8s %12s %9s %9s %10s\n", "rate", "taps", "MAC/out", "Msamples/s", "gain dB",
+        "SINAD dB", "alias dB");
+    bool ok = true;
+    for (auto& ratio : ratios) {
+        for (int taps : { 8, 16, 32 }) {
+            ok = Benchmark(ratio[0], ratio[1], taps, seconds) && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
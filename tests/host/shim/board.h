@@ -0,0 +1,6 @@
+#ifndef HOST_BOARD_H
+#define HOST_BOARD_H
+
+// Stands in for main/boards/common/board.h, which audio_codec.h includes but does not use
+
+#endif // HOST_BOARD_H
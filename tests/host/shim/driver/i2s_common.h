@@ -0,0 +1,34 @@
+#ifndef HOST_DRIVER_I2S_COMMON_H
+#define HOST_DRIVER_I2S_COMMON_H
+
+#include <cstddef>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+
+/*
+ * Host codecs have no I2S channels: the handles stay null, and AudioCodec::Start() only
+ * touches the driver for channels that exist.
+ */
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
+
+typedef struct {
+    void* data;
+    size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+
+typedef struct {
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+inline esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks, void* user_data) { return ESP_FAIL; }
+inline esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) { return ESP_FAIL; }
+inline esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) { return ESP_FAIL; }
+
+#endif // HOST_DRIVER_I2S_COMMON_H
@@ -0,0 +1,10 @@
+#ifndef HOST_FREERTOS_EVENT_GROUPS_H
+#define HOST_FREERTOS_EVENT_GROUPS_H
+
+#include "FreeRTOS.h"
+
+// Only the types, audio_codec.h includes this header but the codec does not use event groups
+typedef struct HostEventGroup* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#endif // HOST_FREERTOS_EVENT_GROUPS_H
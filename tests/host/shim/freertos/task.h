@@ -0,0 +1,20 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+/*
+ * Every std::thread is a task. Its handle carries the notification counter, so SpscQueue
+ * and anything else built on task notifications behaves as on the device.
+ */
+
+struct HostTask;
+typedef HostTask* TaskHandle_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+TickType_t xTaskGetTickCount();
+void vTaskDelay(TickType_t ticks);
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,120 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "settings.h"
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint32_t notifications = 0;
+};
+
+static const auto start_time = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    // Handles are never freed, a queue may still hold the handle of a thread that has exited
+    thread_local HostTask* task = new HostTask();
+    return task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->condition.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task] { return task->notifications > 0; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->condition.wait(lock, ready);
+    } else {
+        task->condition.wait_for(lock, std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS), ready);
+    }
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+static std::mutex settings_mutex;
+static std::map<std::string, std::string> settings_values;
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+Settings::~Settings() {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    auto it = settings_values.find(ns_ + "." + key);
+    return it == settings_values.end() ? default_value : it->second;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    if (!read_write_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    settings_values[ns_ + "." + key] = value;
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    std::string value = GetString(key);
+    return value.empty() ? default_value : std::stoi(value);
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    SetString(key, std::to_string(value));
+}
+
+bool Settings::GetBool(const std::string& key, bool default_value) {
+    return GetInt(key, default_value) != 0;
+}
+
+void Settings::SetBool(const std::string& key, bool value) {
+    SetInt(key, value);
+}
+
+void Settings::EraseKey(const std::string& key) {
+    if (!read_write_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    settings_values.erase(ns_ + "." + key);
+}
+
+void Settings::EraseAll() {
+    if (!read_write_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    std::string prefix = ns_ + ".";
+    for (auto it = settings_values.begin(); it != settings_values.end();) {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? settings_values.erase(it) : std::next(it);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef HOST_SETTINGS_H
+#define HOST_SETTINGS_H
+
+#include <string>
+#include <cstdint>
+
+/*
+ * In-memory stand-in for the NVS backed Settings in main/settings.h, with the same
+ * interface. Values are shared by all instances and live until the process exits.
+ */
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false);
+    ~Settings();
+
+    std::string GetString(const std::string& key, const std::string& default_value = "");
+    void SetString(const std::string& key, const std::string& value);
+    int32_t GetInt(const std::string& key, int32_t default_value = 0);
+    void SetInt(const std::string& key, int32_t value);
+    bool GetBool(const std::string& key, bool default_value = false);
+    void SetBool(const std::string& key, bool value);
+    void EraseKey(const std::string& key);
+    void EraseAll();
+
+private:
+    std::string ns_;
+    bool read_write_ = false;
+};
+
+#endif // HOST_SETTINGS_H
@@ -0,0 +1,150 @@
+/*
+ * OggDemuxer against the bundled sound assets, which scripts/ogg_converter produces.
+ *
+ * Every .ogg under the assets directory is demuxed in one piece and in chunks of several
+ * sizes, and the packets must match those of a straightforward page by page parse. The
+ * TOC durations are checked on the assets and on hand made packets.
+ */
+
+#include "ogg_demuxer.h"
+#include "wav_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            std::fprintf(stderr, __VA_ARGS__); \
+            std::fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+typedef std::vector<std::vector<uint8_t>> Packets;
+
+// Reference parse: walk whole pages and join the lacing values, without any resync or chunking
+static bool ParseOgg(const std::string& ogg, Packets& packets, int& sample_rate) {
+    auto data = reinterpret_cast<const uint8_t*>(ogg.data());
+    size_t offset = 0;
+    std::vector<uint8_t> packet;
+    Packets all;
+    while (offset < ogg.size()) {
+        if (offset + 27 > ogg.size() || std::memcmp(data + offset, "OggS", 4) != 0) {
+            return false;
+        }
+        size_t segment_count = data[offset + 26];
+        const uint8_t* segments = data + offset + 27;
+        size_t body = offset + 27 + segment_count;
+        for (size_t i = 0; i < segment_count; i++) {
+            packet.insert(packet.end(), data + body, data + body + segments[i]);
+            body += segments[i];
+            if (segments[i] < 255) {
+                all.push_back(packet);
+                packet.clear();
+            }
+        }
+        offset = body;
+    }
+    if (all.size() < 2 || all[0].size() < 19 || std::memcmp(all[0].data(), "OpusHead", 8) != 0 ||
+            std::memcmp(all[1].data(), "OpusTags", 8) != 0) {
+        return false;
+    }
+    sample_rate = all[0][12] | (all[0][13] << 8) | (all[0][14] << 16) | (all[0][15] << 24);
+    packets.assign(all.begin() + 2, all.end());
+    return true;
+}
+
+static Packets Demux(const std::string& ogg, size_t chunk_size, OggDemuxer& demuxer) {
+    Packets packets;
+    demuxer.Reset();
+    demuxer.OnPacket([&packets](const uint8_t* data, size_t size) {
+        packets.emplace_back(data, data + size);
+    });
+    auto data = reinterpret_cast<const uint8_t*>(ogg.data());
+    for (size_t offset = 0; offset < ogg.size(); offset += chunk_size) {
+        demuxer.Process(data + offset, std::min(chunk_size, ogg.size() - offset));
+    }
+    return packets;
+}
+
+static void TestPacketDuration() {
+    auto duration = [](std::vector<uint8_t> packet) {
+        return OggDemuxer::GetOpusPacketDuration(packet.data(), packet.size());
+    };
+    // TOC: configuration number << 3 | stereo << 2 | frame count code
+    CHECK(duration({}) == 0, "empty packet");
+    CHECK(duration({1 << 3}) == 20, "SILK 20 ms");
+    CHECK(duration({3 << 3}) == 60, "SILK 60 ms");
+    CHECK(duration({(3 << 3) | 1}) == 120, "two SILK 60 ms frames");
+    CHECK(duration({(3 << 3) | 3, 3}) == 0, "three SILK 60 ms frames exceed 120 ms");
+    CHECK(duration({13 << 3}) == 20, "hybrid 20 ms");
+    CHECK(duration({19 << 3}) == 20, "CELT 20 ms");
+    CHECK(duration({17 << 3}) == 5, "CELT 5 ms");
+    CHECK(duration({16 << 3}) == 0, "CELT 2.5 ms is not whole milliseconds");
+    CHECK(duration({(16 << 3) | 1}) == 5, "two CELT 2.5 ms frames");
+    CHECK(duration({(16 << 3) | 3, 3}) == 0, "three CELT 2.5 ms frames");
+    CHECK(duration({(16 << 3) | 3, 4}) == 10, "four CELT 2.5 ms frames");
+    CHECK(duration({(19 << 3) | 3}) == 0, "code 3 without the frame count byte");
+    CHECK(duration({(19 << 3) | 3, 0}) == 0, "code 3 with no frames");
+}
+
+static void TestAsset(const std::filesystem::path& path, OggDemuxer& demuxer, size_t& packet_total) {
+    std::string ogg;
+    CHECK(ReadFile(path.string(), ogg), "%s", path.c_str());
+    Packets expected;
+    int sample_rate = 0;
+    if (!ParseOgg(ogg, expected, sample_rate)) {
+        CHECK(false, "%s is not an Ogg Opus stream", path.c_str());
+        return;
+    }
+    CHECK(!expected.empty(), "%s has no audio packets", path.c_str());
+    for (auto& packet : expected) {
+        int duration = OggDemuxer::GetOpusPacketDuration(packet.data(), packet.size());
+        CHECK(duration > 0 && duration <= 120, "%s: packet duration %d ms", path.c_str(), duration);
+    }
+
+    for (size_t chunk_size : { ogg.size(), (size_t)1, (size_t)7, (size_t)255, (size_t)4096 }) {
+        Packets packets = Demux(ogg, chunk_size, demuxer);
+        CHECK(packets == expected, "%s in %zu byte chunks: %zu packets, %zu expected", path.c_str(),
+            chunk_size, packets.size(), expected.size());
+        CHECK(demuxer.sample_rate() == sample_rate && demuxer.channels() == 1, "%s: %d Hz, %d channels",
+            path.c_str(), demuxer.sample_rate(), demuxer.channels());
+    }
+
+    // Garbage before the first page, as after a lost chunk, is skipped up to the next capture pattern
+    std::string noisy = "OgOggxOgg junk" + ogg;
+    CHECK(Demux(noisy, 5, demuxer) == expected, "%s after garbage", path.c_str());
+    packet_total += expected.size();
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: %s ASSETS_DIR\n", argv[0]);
+        return 2;
+    }
+    TestPacketDuration();
+
+    std::vector<std::filesystem::path> assets;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(argv[1])) {
+        if (entry.is_regular_file() && entry.path().extension() == ".ogg") {
+            assets.push_back(entry.path());
+        }
+    }
+    std::sort(assets.begin(), assets.end());
+    CHECK(!assets.empty(), "no .ogg files under %s", argv[1]);
+
+    OggDemuxer demuxer;
+    size_t packet_total = 0;
+    for (auto& path : assets) {
+        TestAsset(path, demuxer, packet_total);
+    }
+    std::printf("%zu assets, %zu packets, %d failures\n", assets.size(), packet_total, failures);
+    return failures == 0 ? 0 : 1;
+}
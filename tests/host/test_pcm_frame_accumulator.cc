@@ -0,0 +1,130 @@
+/*
+ * PcmFrameAccumulator: chunks of odd sizes come out as whole frames in order, frame size
+ * changes take effect on the frame being filled, and a callback that copies the frame
+ * leaves it without any further allocation.
+ */
+
+#include "pcm_frame_accumulator.h"
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "FAILED %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+            std::fprintf(stderr, __VA_ARGS__); \
+            std::fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static std::vector<int16_t> Ramp(size_t samples) {
+    std::vector<int16_t> ramp(samples);
+    for (size_t i = 0; i < samples; i++) {
+        ramp[i] = static_cast<int16_t>(i);
+    }
+    return ramp;
+}
+
+// Feed `input` in chunks cycling through `chunks`, collect what the callback copies
+static std::vector<std::vector<int16_t>> Run(PcmFrameAccumulator& accumulator, const std::vector<int16_t>& input,
+        const std::vector<size_t>& chunks, size_t* reallocations = nullptr) {
+    std::vector<std::vector<int16_t>> frames;
+    const int16_t* buffer = nullptr;
+    auto on_frame = [&](std::vector<int16_t>&& frame) {
+        if (buffer != nullptr && frame.data() != buffer && reallocations != nullptr) {
+            (*reallocations)++;
+        }
+        buffer = frame.data();
+        frames.emplace_back(frame.begin(), frame.end());
+    };
+    size_t offset = 0;
+    for (size_t i = 0; offset < input.size(); i++) {
+        size_t count = std::min(chunks[i % chunks.size()], input.size() - offset);
+        accumulator.Push(input.data() + offset, count, on_frame);
+        offset += count;
+    }
+    return frames;
+}
+
+static void TestChunkSizes() {
+    // 20 and 60 ms frames, AFE fetches of 512 samples, enhancer hops of 128 and odd sizes
+    for (size_t frame_samples : { 320, 960 }) {
+        for (auto chunks : std::vector<std::vector<size_t>>{ {1}, {7}, {128}, {512}, {1000}, {3, 511, 64, 2049} }) {
+            PcmFrameAccumulator accumulator;
+            accumulator.SetFrameSamples(frame_samples);
+            auto input = Ramp(frame_samples * 25 + 17);
+            size_t reallocations = 0;
+            auto frames = Run(accumulator, input, chunks, &reallocations);
+            CHECK(frames.size() == 25, "%zu samples per frame, chunks of %zu: %zu frames", frame_samples,
+                chunks[0], frames.size());
+            std::vector<int16_t> joined;
+            for (auto& frame : frames) {
+                CHECK(frame.size() == frame_samples, "frame of %zu samples", frame.size());
+                joined.insert(joined.end(), frame.begin(), frame.end());
+            }
+            CHECK(std::equal(joined.begin(), joined.end(), input.begin()), "samples out of order");
+            CHECK(reallocations == 0, "%zu samples per frame, chunks of %zu: %zu reallocations", frame_samples,
+                chunks[0], reallocations);
+        }
+    }
+}
+
+static void TestFrameSizeChange() {
+    PcmFrameAccumulator accumulator;
+    accumulator.SetFrameSamples(960);
+    auto input = Ramp(4000);
+    std::vector<std::vector<int16_t>> frames;
+    auto on_frame = [&frames](std::vector<int16_t>&& frame) {
+        frames.emplace_back(frame.begin(), frame.end());
+    };
+
+    // 700 samples into a 60 ms frame, then 20 ms frames: the partial frame becomes two
+    accumulator.Push(input.data(), 700, on_frame);
+    CHECK(frames.empty(), "%zu frames before the first one is full", frames.size());
+    accumulator.SetFrameSamples(320);
+    accumulator.Push(input.data() + 700, 1, on_frame);
+    CHECK(frames.size() == 2 && frames[0].size() == 320 && frames[1].size() == 320, "%zu frames after shrinking",
+        frames.size());
+
+    // Back to 60 ms frames, the 61 samples held are the start of the next one
+    accumulator.SetFrameSamples(960);
+    accumulator.Push(input.data() + 701, 3299, on_frame);
+    std::vector<int16_t> joined;
+    for (auto& frame : frames) {
+        joined.insert(joined.end(), frame.begin(), frame.end());
+    }
+    CHECK(frames.size() == 5 && frames[2].size() == 960 && frames[4].size() == 960, "%zu frames after growing",
+        frames.size());
+    CHECK(std::equal(joined.begin(), joined.end(), input.begin()), "samples out of order after size changes");
+
+    // A cleared accumulator starts a new frame
+    accumulator.Push(input.data(), 100, on_frame);
+    accumulator.Clear();
+    accumulator.Push(input.data() + 500, 960, on_frame);
+    CHECK(frames.size() == 6 && frames[5][0] == input[500], "the partial frame was not dropped");
+}
+
+static void TestMovingCallback() {
+    // A callback that keeps the frame takes its buffer, the next frame gets a new one
+    PcmFrameAccumulator accumulator;
+    accumulator.SetFrameSamples(320);
+    std::vector<std::vector<int16_t>> frames;
+    auto input = Ramp(320 * 3);
+    accumulator.Push(input.data(), input.size(), [&frames](std::vector<int16_t>&& frame) {
+        frames.push_back(std::move(frame));
+    });
+    CHECK(frames.size() == 3 && frames[2].size() == 320 && frames[2][319] == input[959], "%zu frames moved",
+        frames.size());
+}
+
+int main() {
+    TestChunkSizes();
+    TestFrameSizeChange();
+    TestMovingCallback();
+    std::printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
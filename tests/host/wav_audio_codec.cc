@@ -0,0 +1,115 @@
+#include "wav_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "WavAudioCodec"
+
+WavAudioCodec::WavAudioCodec(std::string_view wav, int output_sample_rate, bool input_reference, bool paced)
+    : paced_(paced) {
+    duplex_ = true;
+    input_channels_ = 1;
+    input_sample_rate_ = 16000;
+    output_sample_rate_ = output_sample_rate;
+
+    if (!ParseWav(wav)) {
+        ESP_LOGE(TAG, "Invalid WAV data, the input will be silent");
+    }
+    input_reference_ = input_reference && input_channels_ > 1;
+}
+
+WavAudioCodec::~WavAudioCodec() {
+}
+
+bool WavAudioCodec::ParseWav(std::string_view wav) {
+    auto data = reinterpret_cast<const uint8_t*>(wav.data());
+    size_t size = wav.size();
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool has_format = false;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t* chunk = data + offset;
+        uint32_t chunk_size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | (chunk[7] << 24);
+        if (offset + 8 + chunk_size > size) {
+            chunk_size = size - offset - 8;
+        }
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            uint16_t format = chunk[8] | (chunk[9] << 8);
+            uint16_t channels = chunk[10] | (chunk[11] << 8);
+            uint32_t sample_rate = chunk[12] | (chunk[13] << 8) | (chunk[14] << 16) | (chunk[15] << 24);
+            uint16_t bits_per_sample = chunk[22] | (chunk[23] << 8);
+            if (format != 1 || bits_per_sample != 16 || channels < 1 || channels > 4) {
+                ESP_LOGE(TAG, "Unsupported WAV format %u, %u channels, %u bits", format, channels, bits_per_sample);
+                return false;
+            }
+            input_channels_ = channels;
+            input_sample_rate_ = sample_rate;
+            has_format = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0 && has_format) {
+            wav_samples_ = reinterpret_cast<const int16_t*>(chunk + 8);
+            // Keep whole frames so the channels never swap when the input loops
+            wav_sample_count_ = chunk_size / sizeof(int16_t) / input_channels_ * input_channels_;
+            ESP_LOGI(TAG, "WAV input: %d Hz, %d channels, %zu samples", input_sample_rate_, input_channels_, wav_sample_count_);
+            return wav_sample_count_ > 0;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+void WavAudioCodec::EnableInput(bool enable) {
+    if (enable && !input_enabled_) {
+        input_start_time_ = esp_timer_get_time();
+        input_samples_ = 0;
+    }
+    AudioCodec::EnableInput(enable);
+}
+
+void WavAudioCodec::EnableOutput(bool enable) {
+    if (enable && !output_enabled_) {
+        output_start_time_ = esp_timer_get_time();
+        output_samples_ = 0;
+    }
+    AudioCodec::EnableOutput(enable);
+}
+
+void WavAudioCodec::Pace(int64_t start_time, uint64_t samples, int sample_rate, int channels) {
+    if (!paced_) {
+        return;
+    }
+    // Block until the samples handled so far would have taken that long on a real codec
+    int64_t due_time = start_time + (int64_t)(samples / channels * 1000000 / sample_rate);
+    int64_t wait_us = due_time - esp_timer_get_time();
+    if (wait_us > 0) {
+        vTaskDelay(std::max<TickType_t>(1, pdMS_TO_TICKS(wait_us / 1000)));
+    }
+}
+
+int WavAudioCodec::Read(int16_t* dest, int samples) {
+    if (wav_sample_count_ == 0) {
+        std::fill(dest, dest + samples, 0);
+    } else {
+        int copied = 0;
+        while (copied < samples) {
+            size_t count = std::min<size_t>(samples - copied, wav_sample_count_ - read_position_);
+            std::memcpy(dest + copied, wav_samples_ + read_position_, count * sizeof(int16_t));
+            copied += count;
+            read_position_ = (read_position_ + count) % wav_sample_count_;
+        }
+    }
+    input_samples_ += samples;
+    Pace(input_start_time_, input_samples_, input_sample_rate_, input_channels_);
+    return samples;
+}
+
+int WavAudioCodec::Write(const int16_t* data, int samples) {
+    output_samples_ += samples;
+    Pace(output_start_time_, output_samples_, output_sample_rate_, output_channels_);
+    return samples;
+}
@@ -0,0 +1,48 @@
+#ifndef _WAV_AUDIO_CODEC_H
+#define _WAV_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <string_view>
+#include <cstdint>
+
+/*
+ * Codec without audio hardware: the microphone plays a 16-bit PCM WAV in a loop and the
+ * speaker output is only counted. When paced, reads and writes take as long as on a real
+ * codec, so the pipeline runs at real-time speed; unpaced it runs as fast as the host can.
+ *
+ * With `input_reference` the last WAV channel is the AEC reference, as on boards that
+ * loop the speaker signal back into the ADC.
+ */
+class WavAudioCodec : public AudioCodec {
+private:
+    const bool paced_;
+    const int16_t* wav_samples_ = nullptr;
+    size_t wav_sample_count_ = 0;
+    size_t read_position_ = 0;
+    int64_t input_start_time_ = 0;
+    int64_t output_start_time_ = 0;
+    uint64_t input_samples_ = 0;
+    uint64_t output_samples_ = 0;
+
+    bool ParseWav(std::string_view wav);
+    void Pace(int64_t start_time, uint64_t samples, int sample_rate, int channels);
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+public:
+    // `wav` must stay valid for the lifetime of the codec
+    WavAudioCodec(std::string_view wav, int output_sample_rate, bool input_reference = false, bool paced = true);
+    virtual ~WavAudioCodec();
+
+    virtual void EnableInput(bool enable) override;
+    virtual void EnableOutput(bool enable) override;
+
+    inline bool valid() const { return wav_sample_count_ > 0; }
+    inline size_t wav_frames() const { return wav_sample_count_ / input_channels_; }
+    inline uint64_t input_samples() const { return input_samples_; }
+    inline uint64_t output_samples() const { return output_samples_; }
+};
+
+#endif // _WAV_AUDIO_CODEC_H
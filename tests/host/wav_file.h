@@ -0,0 +1,54 @@
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+// Whole-file helpers for the host tools, WAV data is 16-bit PCM in the host byte order (little-endian)
+
+inline bool ReadFile(const std::string& path, std::string& data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline bool WriteFile(const std::string& path, const std::string& data) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+    return file.good();
+}
+
+inline std::string MakeWav(const std::vector<int16_t>& samples, int sample_rate, int channels) {
+    auto put32 = [](std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back(static_cast<char>(value >> (i * 8)));
+        }
+    };
+    auto put16 = [](std::string& out, uint16_t value) {
+        out.push_back(static_cast<char>(value));
+        out.push_back(static_cast<char>(value >> 8));
+    };
+    uint32_t data_size = samples.size() * sizeof(int16_t);
+    std::string wav = "RIFF";
+    put32(wav, 36 + data_size);
+    wav += "WAVEfmt ";
+    put32(wav, 16);
+    put16(wav, 1);
+    put16(wav, channels);
+    put32(wav, sample_rate);
+    put32(wav, sample_rate * channels * sizeof(int16_t));
+    put16(wav, channels * sizeof(int16_t));
+    put16(wav, 16);
+    wav += "data";
+    put32(wav, data_size);
+    wav.append(reinterpret_cast<const char*>(samples.data()), data_size);
+    return wav;
+}
+
+#endif // WAV_FILE_H